@@ -0,0 +1,237 @@
+#include "model/SubvolModel.h"
+#include "util/Btrfs.h"
+#include "util/MetadataCache.h"
+#include "util/Snapper.h"
+#include "util/System.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <btrfsutil.h>
+
+#include <algorithm>
+#include <functional>
+
+namespace {
+
+// Every image is at least this big so mkfs.btrfs is happy, the file is sparse so only what is written uses space
+constexpr qint64 MIN_IMAGE_SIZE = 1024LL * 1024 * 1024;
+
+// The extra image space reserved for each subvolume
+constexpr qint64 SUBVOLUME_IMAGE_SIZE = 64 * 1024;
+
+/**
+ * @brief Runs a command needed to set up an image and reports it on stderr if it fails
+ * @return True if the command succeeded
+ */
+bool runSetupCmd(const QString &cmd, const QStringList &args)
+{
+    const Result result = System::runCmd(cmd, args, true, System::minutes(10));
+    if (result.exitCode != 0) {
+        QTextStream(stderr) << cmd << " " << args.join(' ') << " failed: " << result.output << Qt::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Writes a snapper info.xml for snapshot @p number
+ * @return True on success
+ */
+bool writeInfoXml(const QString &filename, const int number)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        return false;
+    }
+
+    QTextStream stream(&file);
+    stream << "<?xml version=\"1.0\"?>\n"
+           << "<snapshot>\n"
+           << "  <type>single</type>\n"
+           << "  <num>" << number << "</num>\n"
+           << "  <date>" << QDateTime::currentDateTimeUtc().toString("yyyy-MM-dd hh:mm:ss") << "</date>\n"
+           << "  <description>benchmark snapshot " << number << "</description>\n"
+           << "  <cleanup>number</cleanup>\n"
+           << "</snapshot>\n";
+    return stream.status() == QTextStream::Ok;
+}
+
+/**
+ * @brief Fills a freshly created filesystem with plain subvolumes and a snapper style layout of snapshots
+ *
+ * The plain subvolumes are created as subvols/<n>.  The snapper layout is @ with a nested .snapshots subvolume
+ * holding <n>/snapshot and <n>/info.xml, the same as snapper creates for a root config.
+ * @param mountpoint - Where the top level of the filesystem is mounted
+ * @param subvolCount - The number of plain subvolumes to create
+ * @param snapshotCount - The number of snapshots of @ to create
+ * @return True on success
+ */
+bool populateImage(const QString &mountpoint, const int subvolCount, const int snapshotCount)
+{
+    const QDir top(mountpoint);
+    if (!top.mkpath("subvols")) {
+        return false;
+    }
+    for (int i = 1; i <= subvolCount; i++) {
+        if (btrfs_util_create_subvolume(top.filePath("subvols/" + QString::number(i)).toLocal8Bit(), 0, nullptr, nullptr) !=
+            BTRFS_UTIL_OK) {
+            return false;
+        }
+    }
+
+    const QString root = top.filePath("@");
+    const QString snapshotDir = top.filePath("@/.snapshots");
+    if (btrfs_util_create_subvolume(root.toLocal8Bit(), 0, nullptr, nullptr) != BTRFS_UTIL_OK ||
+        btrfs_util_create_subvolume(snapshotDir.toLocal8Bit(), 0, nullptr, nullptr) != BTRFS_UTIL_OK) {
+        return false;
+    }
+    for (int i = 1; i <= snapshotCount; i++) {
+        const QDir dir(snapshotDir + "/" + QString::number(i));
+        if (!dir.mkpath(".") || !writeInfoXml(dir.filePath("info.xml"), i) ||
+            btrfs_util_create_snapshot(root.toLocal8Bit(), dir.filePath("snapshot").toLocal8Bit(), BTRFS_UTIL_CREATE_SNAPSHOT_READ_ONLY,
+                                       nullptr, nullptr) != BTRFS_UTIL_OK) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Runs @p function and returns how long it took in msecs
+ */
+double timeMs(const std::function<void()> &function)
+{
+    QElapsedTimer timer;
+    timer.start();
+    function();
+    return static_cast<double>(timer.nsecsElapsed()) / 1000000;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("btrfs-assistant-bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Times the btrfs-assistant load paths against generated loopback btrfs images");
+    parser.addHelpOption();
+
+    QCommandLineOption sizesOption("sizes", "Comma separated snapshot counts, one image is created for each", "counts", "1000,10000,50000");
+    QCommandLineOption subvolumesOption("subvolumes", "The number of plain subvolumes in every image", "count", "100");
+    QCommandLineOption runsOption("runs", "How many times each load is timed, the first run of an image is cold", "count", "3");
+    QCommandLineOption dirOption("dir", "The directory where the images are created", "path", QDir::tempPath());
+    QCommandLineOption labelOption("label", "A label stored with the results, for example the commit being measured", "label");
+    QCommandLineOption outputOption("output", "Write the JSON results to a file instead of stdout", "file");
+    parser.addOptions({sizesOption, subvolumesOption, runsOption, dirOption, labelOption, outputOption});
+    parser.process(app);
+
+    if (!System::checkRootUid()) {
+        QTextStream(stderr) << "The benchmark must be run as root to create and mount the images" << Qt::endl;
+        return 1;
+    }
+
+    const int subvolCount = parser.value(subvolumesOption).toInt();
+    const int runs = std::max(parser.value(runsOption).toInt(), 1);
+
+    QJsonArray results;
+    const QStringList sizes = parser.value(sizesOption).split(',', Qt::SkipEmptyParts);
+    for (const QString &size : sizes) {
+        const int snapshotCount = size.trimmed().toInt();
+
+        QTemporaryDir workDir(QDir(parser.value(dirOption)).filePath("btrfs-assistant-bench-XXXXXX"));
+        const QString image = workDir.filePath("image");
+        const QString mountpoint = workDir.filePath("mnt");
+        const qint64 imageSize = std::max(MIN_IMAGE_SIZE, (subvolCount + snapshotCount) * SUBVOLUME_IMAGE_SIZE);
+
+        QTextStream(stderr) << "Creating an image with " << subvolCount << " subvolumes and " << snapshotCount << " snapshots" << Qt::endl;
+        QFile imageFile(image);
+        if (!workDir.isValid() || !imageFile.open(QIODevice::WriteOnly) || !imageFile.resize(imageSize) ||
+            !QDir().mkpath(mountpoint) || !runSetupCmd("mkfs.btrfs", {"-q", "-f", image}) ||
+            !runSetupCmd("mount", {"-o", "loop", image, mountpoint})) {
+            return 1;
+        }
+
+        const QString uuid = System::findUuid(mountpoint);
+        const bool isPopulated = populateImage(mountpoint, subvolCount, snapshotCount);
+        if (isPopulated) {
+            const auto addResult = [&](const QString &phase, const int run, const double ms) {
+                results.append(QJsonObject{{"phase", phase},
+                                           {"subvolumes", subvolCount},
+                                           {"snapshots", snapshotCount},
+                                           {"run", run},
+                                           {"cold", run == 0},
+                                           {"ms", ms}});
+            };
+
+            // The Btrfs object mounts filesystem roots as needed and unmounts them when it is destroyed
+            Btrfs btrfs;
+            Snapper snapper(&btrfs, "snapper");
+            SubvolumeModel model;
+            SubvolumeFilterModel filterModel;
+            filterModel.setSourceModel(&model);
+
+            // Only the image is loaded so the timings don't depend on the other filesystems on the host
+            const QStringList uuids = {uuid};
+            for (int run = 0; run < runs; run++) {
+                addResult("Btrfs::loadVolumes", run, timeMs([&btrfs, &uuids]() { btrfs.loadVolumes(uuids); }));
+                addResult("Btrfs::loadSubvols (full)", run, timeMs([&btrfs, &uuid]() { btrfs.loadSubvols(uuid, true); }));
+                addResult("Btrfs::loadSubvols", run, timeMs([&btrfs, &uuid]() { btrfs.loadSubvols(uuid); }));
+                addResult("Snapper::loadSubvols", run, timeMs([&snapper, &uuids]() { snapper.loadSubvols(uuids); }));
+                const QMap<QString, BtrfsFilesystem> filesystems = {{uuid, btrfs.filesystems().value(uuid)}};
+                addResult("SubvolumeModel::load", run, timeMs([&model, &filesystems]() { model.load(filesystems); }));
+                // The filter model only filters when it is asked for its rows
+                addResult("SubvolumeFilterModel::filter", run, timeMs([&filterModel]() {
+                              filterModel.setIncludeSnapshots(true);
+                              filterModel.rowCount();
+                              filterModel.setNameFilter("1");
+                              filterModel.rowCount();
+                              filterModel.setNameFilter("snapshot");
+                              filterModel.rowCount();
+                              filterModel.setNameFilter(QString());
+                              filterModel.rowCount();
+                              filterModel.setIncludeSnapshots(false);
+                              filterModel.rowCount();
+                          }));
+            }
+        } else {
+            QTextStream(stderr) << "Failed to populate the image" << Qt::endl;
+        }
+
+        // Keep the throwaway filesystem out of the metadata cache used by the application
+        MetadataCache::instance().removeFilesystem(uuid);
+        MetadataCache::instance().save();
+
+        if (!runSetupCmd("umount", {mountpoint}) || !isPopulated) {
+            return 1;
+        }
+    }
+
+    QJsonObject report;
+    report.insert("label", parser.value(labelOption));
+    report.insert("timestamp", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    report.insert("results", results);
+    const QByteArray json = QJsonDocument(report).toJson();
+
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+            QTextStream(stderr) << "Failed to write " << file.fileName() << Qt::endl;
+            return 1;
+        }
+    } else {
+        QTextStream(stdout) << json;
+    }
+
+    return 0;
+}
@@ -1,7 +1,10 @@
 #include "ui/Cli.h"
 #include "ui/MainWindow.h"
+#include "util/CommandRunner.h"
 #include "util/BtrfsMaintenance.h"
+#include "util/MountTable.h"
 #include "util/Settings.h"
+#include "util/Trace.h"
 
 #include <QApplication>
 #include <QCommandLineParser>
@@ -39,13 +42,34 @@ int main(int argc, char *argv[])
                                      QCoreApplication::translate("main", "Restore the given subvolume/UUID"),
                                      QCoreApplication::translate("main", "subvolume,UUID"));
     parser.addOption(restoreOption);
+
+    QCommandLineOption traceOption(QStringList() << "trace",
+                                   QCoreApplication::translate("main", "Write a Chrome trace of where the time is spent to the given file"),
+                                   QCoreApplication::translate("main", "file"));
+    parser.addOption(traceOption);
     parser.process(app);
 
+    // Tracing can also be turned on with an environment variable holding the path of the trace file
+    const QString tracePath = parser.isSet(traceOption) ? parser.value(traceOption) : qEnvironmentVariable("BTRFS_ASSISTANT_TRACE");
+    if (!tracePath.isEmpty()) {
+        Trace::instance().start(tracePath);
+    }
+
+    // The commands can be recorded to a file and replayed from it later without running anything on the system, the
+    // filesystems and snapshots are still read directly so only the commands are replayed
+    const QString replayPath = qEnvironmentVariable("BTRFS_ASSISTANT_REPLAY");
+    const QString recordPath = qEnvironmentVariable("BTRFS_ASSISTANT_RECORD");
+    if (!replayPath.isEmpty()) {
+        System::setCommandRunner(std::make_unique<ReplayRunner>(replayPath));
+    } else if (!recordPath.isEmpty()) {
+        System::setCommandRunner(std::make_unique<RecordingRunner>(std::make_unique<ProcessRunner>(), recordPath));
+    }
+
     QString snapperPath = Settings::instance().value("snapper", "/usr/bin/snapper").toString();
     QString btrfsMaintenanceConfig = Settings::instance().value("bm_config", "/etc/default/btrfsmaintenance").toString();
 
     // Ensure we are running on a system with btrfs
-    if (!System::runCmd("findmnt --real -no fstype ", false).output.contains("btrfs")) {
+    if (!MountTable::instance().hasBtrfs()) {
         QTextStream(stderr) << QCoreApplication::translate("main", "Error: No Btrfs filesystems found") << Qt::endl;
         return 1;
     }
@@ -59,6 +83,13 @@ int main(int argc, char *argv[])
         snapper = new Snapper(&btrfs, snapperPath);
     }
 
+    // The command line needs everything up front, the main window loads the data for each tab when it is first shown
+    const bool isCli = snapper != nullptr && (parser.isSet(listOption) || parser.isSet(restoreOption));
+    if (isCli) {
+        btrfs.loadVolumes();
+        snapper->load();
+    }
+
     if (parser.isSet(listOption) && snapper != nullptr) {
         return Cli::listSnapshots(snapper);
     } else if (parser.isSet(restoreOption) && snapper != nullptr) {
@@ -0,0 +1,73 @@
+#include "model/DiffModel.h"
+
+namespace {
+
+// The number of columns a tab advances at most
+constexpr int TAB_WIDTH = 8;
+
+} // namespace
+
+int DiffModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+
+    return m_lines.count();
+}
+
+QVariant DiffModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_lines.count()) {
+        return {};
+    }
+
+    const QString &line = m_lines.at(index.row());
+    if (role == Qt::DisplayRole) {
+        return line;
+    }
+
+    if (role != Role::Kind) {
+        return {};
+    }
+
+    if (m_isMessage) {
+        return LineKind::Message;
+    } else if (line.startsWith("@@")) {
+        return LineKind::Hunk;
+    } else if (line.startsWith('+')) {
+        return LineKind::Added;
+    } else if (line.startsWith('-')) {
+        return LineKind::Removed;
+    }
+
+    return LineKind::Context;
+}
+
+void DiffModel::load(const QStringList &lines)
+{
+    beginResetModel();
+    m_lines = lines;
+    m_isMessage = false;
+    m_hunkRows.clear();
+    m_maxLineLength = 0;
+
+    for (int row = 0; row < m_lines.count(); row++) {
+        const QString &line = m_lines.at(row);
+        if (line.startsWith("@@")) {
+            m_hunkRows.append(row);
+        }
+        m_maxLineLength = qMax(m_maxLineLength, line.length() + line.count('\t') * (TAB_WIDTH - 1));
+    }
+
+    endResetModel();
+}
+
+void DiffModel::setMessage(const QString &message)
+{
+    beginResetModel();
+    m_lines = QStringList{message};
+    m_isMessage = true;
+    m_hunkRows.clear();
+    m_maxLineLength = message.length();
+    endResetModel();
+}
@@ -0,0 +1,57 @@
+#ifndef DIFFMODEL_H
+#define DIFFMODEL_H
+
+#include <QAbstractListModel>
+#include <QStringList>
+#include <QVector>
+
+/**
+ * @brief The DiffModel class is a list of the lines of a unified diff
+ *
+ * The lines are only indexed when they are loaded, what kind of line each row is comes from its first character when
+ * the view asks for it so only the rows on screen are ever looked at after that.
+ */
+class DiffModel : public QAbstractListModel {
+    Q_OBJECT
+
+  public:
+    enum LineKind { Context, Added, Removed, Hunk, Message };
+
+    enum Role { Kind = Qt::UserRole };
+
+    explicit DiffModel(QObject *parent = nullptr) : QAbstractListModel(parent) {}
+
+    // Basic model functions
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    /**
+     * @brief Returns the rows which start a hunk in ascending order
+     */
+    const QVector<int> &hunkRows() const { return m_hunkRows; }
+
+    /**
+     * @brief Returns the length of the longest line in characters with tabs expanded
+     */
+    int maxLineLength() const { return m_maxLineLength; }
+
+    /**
+     * @brief Replaces the contents of the model with a diff
+     * @param lines - The lines of a diff in unified format
+     */
+    void load(const QStringList &lines);
+
+    /**
+     * @brief Replaces the contents of the model with a single line which isn't part of a diff
+     * @param message - The text to show
+     */
+    void setMessage(const QString &message);
+
+  private:
+    QStringList m_lines;
+    QVector<int> m_hunkRows;
+    int m_maxLineLength = 0;
+    bool m_isMessage = false;
+};
+
+#endif // DIFFMODEL_H
@@ -0,0 +1,164 @@
+#include "model/SnapperModel.h"
+#include "util/Trace.h"
+
+QVariant SnapperSnapshotModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole) {
+        return QAbstractTableModel::headerData(section, orientation, role);
+    }
+
+    if (orientation == Qt::Vertical) {
+        return section;
+    }
+
+    switch (section) {
+    case Column::Number:
+        return tr("Number", "The number associated with a snapshot");
+    case Column::DateTime:
+        return tr("Date/Time");
+    case Column::Type:
+        return tr("Type");
+    case Column::Cleanup:
+        return tr("Cleanup");
+    case Column::Description:
+        return tr("Description");
+    }
+
+    return QString();
+}
+
+int SnapperSnapshotModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+
+    return m_data.count();
+}
+
+int SnapperSnapshotModel::columnCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+
+    return ColumnCount;
+}
+
+QVariant SnapperSnapshotModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.column() >= ColumnCount || index.row() >= m_data.count()) {
+        return {};
+    }
+
+    if (role != Qt::DisplayRole && role != Role::Sort) {
+        return {};
+    }
+
+    const SnapperSnapshot &snapshot = m_data[index.row()];
+    switch (index.column()) {
+    case Column::Number:
+        return snapshot.number;
+    case Column::DateTime:
+        return snapshot.time;
+    case Column::Type:
+        return snapshot.type;
+    case Column::Cleanup:
+        return snapshot.cleanup;
+    case Column::Description:
+        return snapshot.desc;
+    }
+
+    return QVariant();
+}
+
+const SnapperSnapshot &SnapperSnapshotModel::snapshot(int row) const { return m_data[row]; }
+
+void SnapperSnapshotModel::load(const QVector<SnapperSnapshot> &snapshots)
+{
+    TraceSpan span("SnapperSnapshotModel::load", "model");
+    span.setArg("rows", snapshots.count());
+
+    beginResetModel();
+    m_data = snapshots;
+    endResetModel();
+}
+
+QVariant SnapperSubvolumeModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole) {
+        return QAbstractTableModel::headerData(section, orientation, role);
+    }
+
+    if (orientation == Qt::Vertical) {
+        return section;
+    }
+
+    switch (section) {
+    case Column::Number:
+        return tr("Number", "The number associated with a snapshot");
+    case Column::Subvolume:
+        return tr("Subvolume");
+    case Column::DateTime:
+        return tr("Date/Time");
+    case Column::Type:
+        return tr("Type");
+    case Column::Description:
+        return tr("Description");
+    }
+
+    return QString();
+}
+
+int SnapperSubvolumeModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+
+    return m_data.count();
+}
+
+int SnapperSubvolumeModel::columnCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+
+    return ColumnCount;
+}
+
+QVariant SnapperSubvolumeModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.column() >= ColumnCount || index.row() >= m_data.count()) {
+        return {};
+    }
+
+    if (role != Qt::DisplayRole && role != Role::Sort) {
+        return {};
+    }
+
+    const SnapperSubvolume &subvol = m_data[index.row()];
+    switch (index.column()) {
+    case Column::Number:
+        return subvol.snapshotNum;
+    case Column::Subvolume:
+        return subvol.subvol;
+    case Column::DateTime:
+        return subvol.time;
+    case Column::Type:
+        return subvol.type;
+    case Column::Description:
+        return subvol.desc;
+    }
+
+    return QVariant();
+}
+
+const SnapperSubvolume &SnapperSubvolumeModel::subvolume(int row) const { return m_data[row]; }
+
+void SnapperSubvolumeModel::load(const QVector<SnapperSubvolume> &subvols)
+{
+    TraceSpan span("SnapperSubvolumeModel::load", "model");
+    span.setArg("rows", subvols.count());
+
+    beginResetModel();
+    m_data = subvols;
+    endResetModel();
+}
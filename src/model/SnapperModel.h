@@ -0,0 +1,83 @@
+#ifndef SNAPPERMODEL_H
+#define SNAPPERMODEL_H
+
+#include "util/Snapper.h"
+
+#include <QAbstractTableModel>
+
+/**
+ * @brief The SnapperSnapshotModel class is a table of the snapshots of a single snapper config
+ *
+ * The model only wraps the vector returned from Snapper::snapshots() so the cost of showing a config doesn't depend on
+ * the number of snapshots, the view only asks for the rows it displays.
+ */
+class SnapperSnapshotModel : public QAbstractTableModel {
+    Q_OBJECT
+
+  public:
+    enum Column { Number, DateTime, Type, Cleanup, Description, ColumnCount };
+
+    enum Role { Sort = Qt::UserRole };
+
+    explicit SnapperSnapshotModel(QObject *parent = nullptr) : QAbstractTableModel(parent) {}
+
+    // Basic model functions
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    /**
+     * @brief Returns the SnapperSnapshot for a given row
+     * @param row - A row of the model
+     * @return SnapperSnapshot at that row
+     */
+    const SnapperSnapshot &snapshot(int row) const;
+
+    /**
+     * @brief Replaces the contents of the model
+     * @param snapshots - The snapshots of a snapper config
+     */
+    void load(const QVector<SnapperSnapshot> &snapshots);
+
+  private:
+    QVector<SnapperSnapshot> m_data;
+};
+
+/**
+ * @brief The SnapperSubvolumeModel class is a table of the snapper snapshots which can be restored to a target subvolume
+ */
+class SnapperSubvolumeModel : public QAbstractTableModel {
+    Q_OBJECT
+
+  public:
+    enum Column { Number, Subvolume, DateTime, Type, Description, ColumnCount };
+
+    enum Role { Sort = Qt::UserRole };
+
+    explicit SnapperSubvolumeModel(QObject *parent = nullptr) : QAbstractTableModel(parent) {}
+
+    // Basic model functions
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    /**
+     * @brief Returns the SnapperSubvolume for a given row
+     * @param row - A row of the model
+     * @return SnapperSubvolume at that row
+     */
+    const SnapperSubvolume &subvolume(int row) const;
+
+    /**
+     * @brief Replaces the contents of the model
+     * @param subvols - The snapshots of a restore target
+     */
+    void load(const QVector<SnapperSubvolume> &subvols);
+
+  private:
+    QVector<SnapperSubvolume> m_data;
+};
+
+#endif // SNAPPERMODEL_H
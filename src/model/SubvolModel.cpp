@@ -1,5 +1,95 @@
 #include "model/SubvolModel.h"
 #include "util/System.h"
+#include "util/Trace.h"
+
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <functional>
+
+// How long typing has to pause before a requested name filter is applied
+constexpr int NAME_FILTER_DELAY_MS = 150;
+
+// Source models with at least this many rows compare the names for a requested filter on a worker thread
+constexpr int ASYNC_FILTER_ROWS = 10000;
+
+/**
+ * @brief Formats a subvolume UUID for display
+ * @param uuid - The UUID to format
+ * @return The UUID without braces or an empty QString if @p uuid is null
+ */
+static QString uuidText(const QUuid &uuid) { return uuid.isNull() ? QString() : uuid.toString(QUuid::WithoutBraces); }
+
+/**
+ * @brief Classifies a subvolume by its name
+ * @param name - The path of the subvolume
+ * @return The Kinds which apply to the subvolume
+ */
+static SubvolumeModel::Kinds classify(const QString &name)
+{
+    SubvolumeModel::Kinds kinds;
+    kinds.setFlag(SubvolumeModel::IsSnapper, Btrfs::isSnapper(name));
+    kinds.setFlag(SubvolumeModel::IsTimeshift, Btrfs::isTimeshift(name));
+    kinds.setFlag(SubvolumeModel::IsContainer, Btrfs::isContainer(name));
+    kinds.setFlag(SubvolumeModel::IsBackup, Btrfs::isSubvolumeBackup(name));
+    return kinds;
+}
+
+/**
+ * @brief Packs the three characters starting at @p chars into an index key
+ */
+static quint64 trigramKey(const QChar *chars)
+{
+    return static_cast<quint64>(chars[0].unicode()) << 32 | static_cast<quint64>(chars[1].unicode()) << 16 | chars[2].unicode();
+}
+
+/**
+ * @brief Finds the names which contain @p foldedNameFilter
+ *
+ * This only reads its arguments so it can run on a worker thread with copies of the index.
+ * @param foldedNames - The case folded name of every row
+ * @param trigramRows - The rows containing each trigram of the names
+ * @param foldedNameFilter - The case folded text to look for
+ * @param previousMatches - When not null only these rows are compared instead of the rows from the index
+ * @return A bit for every row which is set if the name matches
+ */
+static QBitArray findMatches(const QVector<QString> &foldedNames, const QHash<quint64, QVector<int>> &trigramRows,
+                             const QString &foldedNameFilter, const QBitArray *previousMatches)
+{
+    QBitArray matches(foldedNames.size());
+
+    if (previousMatches != nullptr) {
+        // The filter got longer so nothing outside the previous result can match
+        for (int row = 0; row < previousMatches->size(); ++row) {
+            if (previousMatches->testBit(row)) {
+                matches.setBit(row, foldedNames.at(row).contains(foldedNameFilter));
+            }
+        }
+    } else if (foldedNameFilter.size() < 3) {
+        // Too short to have a trigram, but comparing the folded names is still much cheaper than going through the model
+        for (int row = 0; row < foldedNames.size(); ++row) {
+            matches.setBit(row, foldedNames.at(row).contains(foldedNameFilter));
+        }
+    } else {
+        // Every matching name contains all the trigrams of the filter so only the rows with the rarest one are compared
+        const QVector<int> *candidates = nullptr;
+        for (int i = 0; i + 3 <= foldedNameFilter.size(); ++i) {
+            const auto it = trigramRows.constFind(trigramKey(foldedNameFilter.constData() + i));
+            if (it == trigramRows.constEnd()) {
+                return matches;
+            }
+            if (candidates == nullptr || it->size() < candidates->size()) {
+                candidates = &*it;
+            }
+        }
+
+        for (const int row : *candidates) {
+            matches.setBit(row, foldedNames.at(row).contains(foldedNameFilter));
+        }
+    }
+
+    return matches;
+}
 
 QVariant SubvolumeModel::headerData(int section, Qt::Orientation orientation, int role) const
 {
@@ -98,11 +188,11 @@ QVariant SubvolumeModel::data(const QModelIndex &index, int role) const
     case Column::Name:
         return subvol.subvolName;
     case Column::Uuid:
-        return subvol.uuid;
+        return uuidText(subvol.uuid);
     case Column::ParentUuid:
-        return subvol.parentUuid;
+        return uuidText(subvol.parentUuid);
     case Column::ReceivedUuid:
-        return subvol.receivedUuid;
+        return uuidText(subvol.receivedUuid);
     case Column::CreatedAt:
         return subvol.createdAt;
     case Column::Generation:
@@ -131,13 +221,19 @@ QVariant SubvolumeModel::data(const QModelIndex &index, int role) const
 
 const Subvolume &SubvolumeModel::subvolume(int row) const { return m_data[row]; }
 
+SubvolumeModel::Kinds SubvolumeModel::kinds(int row) const { return m_kinds[row]; }
+
 void SubvolumeModel::load(const QMap<QString, BtrfsFilesystem> &filesystems)
 {
+    TraceSpan span("SubvolumeModel::load", "model");
+
     // Ensure that multiple threads don't try to update the model at the same time
     QMutexLocker lock(&m_updateMutex);
 
     beginResetModel();
     m_data.clear();
+    m_kinds.clear();
+    m_rows.clear();
 
     const QList<QString> filesystemUuids = filesystems.keys();
 
@@ -146,9 +242,11 @@ void SubvolumeModel::load(const QMap<QString, BtrfsFilesystem> &filesystems)
         for (const Subvolume &subvol : filesystems.value(uuid).subvolumes) {
             if (subvol.id != BTRFS_ROOT_ID && subvol.id != 0) {
                 m_data.append(subvol);
+                m_kinds.append(classify(subvol.subvolName));
             }
         }
     }
+    reindex(0);
 
     endResetModel();
 }
@@ -156,35 +254,133 @@ void SubvolumeModel::load(const QMap<QString, BtrfsFilesystem> &filesystems)
 void SubvolumeModel::addSubvolume(const Subvolume &subvol)
 {
     beginInsertRows(QModelIndex(), m_data.size(), m_data.size());
+    m_rows.insert({subvol.filesystemUuid, subvol.id}, m_data.size());
     m_data.append(subvol);
+    m_kinds.append(classify(subvol.subvolName));
     endInsertRows();
 }
 
-void SubvolumeModel::updateSubvolume(const Subvolume &subvol)
+void SubvolumeModel::applyDelta(const SubvolumeDelta &delta)
 {
-    for (int i = 0; i < m_data.size(); ++i) {
-        Subvolume &existing = m_data[i];
-        if (subvol.id == existing.id && subvol.filesystemUuid == existing.filesystemUuid) {
-            existing = subvol;
-            QModelIndex leftIdx = index(i, 0);
-            QModelIndex rightIdx = index(i, ColumnCount - 1);
-            emit dataChanged(leftIdx, rightIdx);
-            break;
+    TraceSpan span("SubvolumeModel::applyDelta", "model");
+
+    // Ensure that multiple threads don't try to update the model at the same time
+    QMutexLocker lock(&m_updateMutex);
+
+    // Remove from the bottom up so the rows still to be removed don't move, and in contiguous blocks where possible
+    QVector<int> removedRows;
+    for (const uint64_t id : delta.removed) {
+        const int row = m_rows.value({delta.filesystemUuid, id}, -1);
+        if (row != -1) {
+            removedRows.append(row);
         }
     }
+    std::sort(removedRows.begin(), removedRows.end(), std::greater<int>());
+
+    for (int i = 0; i < removedRows.count();) {
+        const int last = removedRows.at(i);
+        int first = last;
+        while (++i < removedRows.count() && removedRows.at(i) == first - 1) {
+            first--;
+        }
+
+        beginRemoveRows(QModelIndex(), first, last);
+        for (int row = first; row <= last; ++row) {
+            m_rows.remove({m_data.at(row).filesystemUuid, m_data.at(row).id});
+        }
+        m_data.remove(first, last - first + 1);
+        m_kinds.remove(first, last - first + 1);
+        endRemoveRows();
+    }
+    if (!removedRows.isEmpty()) {
+        reindex(removedRows.last());
+    }
+
+    // Anything that isn't in the model yet is appended, whether it was reported as added or updated
+    QVector<Subvolume> added;
+    for (const QVector<Subvolume> *subvols : {&delta.updated, &delta.added}) {
+        for (const Subvolume &subvol : *subvols) {
+            // The top level subvolume is never shown
+            if (subvol.id == BTRFS_ROOT_ID || subvol.id == 0) {
+                continue;
+            }
+
+            const int row = m_rows.value({subvol.filesystemUuid, subvol.id}, -1);
+            if (row == -1) {
+                added.append(subvol);
+            } else {
+                m_data[row] = subvol;
+                m_kinds[row] = classify(subvol.subvolName);
+                emit dataChanged(index(row, 0), index(row, ColumnCount - 1));
+            }
+        }
+    }
+
+    if (!added.isEmpty()) {
+        beginInsertRows(QModelIndex(), m_data.size(), m_data.size() + added.size() - 1);
+        m_data.append(added);
+        for (const Subvolume &subvol : qAsConst(added)) {
+            m_kinds.append(classify(subvol.subvolName));
+        }
+        reindex(m_data.size() - added.size());
+        endInsertRows();
+    }
+}
+
+void SubvolumeModel::reindex(int firstRow)
+{
+    for (int row = firstRow; row < m_data.size(); ++row) {
+        m_rows.insert({m_data.at(row).filesystemUuid, m_data.at(row).id}, row);
+    }
+}
+
+void SubvolumeModel::updateSubvolume(const Subvolume &subvol)
+{
+    const int row = m_rows.value({subvol.filesystemUuid, subvol.id}, -1);
+    if (row != -1) {
+        m_data[row] = subvol;
+        m_kinds[row] = classify(subvol.subvolName);
+        emit dataChanged(index(row, 0), index(row, ColumnCount - 1));
+    }
 }
 
 SubvolumeFilterModel::SubvolumeFilterModel(QObject *parent) : QSortFilterProxyModel(parent)
 {
     setSortRole(static_cast<int>(SubvolumeModel::Role::Sort));
-    setFilterCaseSensitivity(Qt::CaseInsensitive);
-    setFilterKeyColumn(SubvolumeModel::Column::Name);
+
+    m_nameFilterTimer.setSingleShot(true);
+    m_nameFilterTimer.setInterval(NAME_FILTER_DELAY_MS);
+    connect(&m_nameFilterTimer, &QTimer::timeout, this, &SubvolumeFilterModel::applyRequestedNameFilter);
+    connect(&m_matchesWatcher, &QFutureWatcher<QBitArray>::finished, this, &SubvolumeFilterModel::applyMatches);
 }
 
 bool SubvolumeFilterModel::includeSnapshots() const { return m_includeSnapshots; }
 
 bool SubvolumeFilterModel::includeContainer() const { return m_includeContainer; }
 
+QString SubvolumeFilterModel::nameFilter() const { return m_nameFilter; }
+
+void SubvolumeFilterModel::setSourceModel(QAbstractItemModel *sourceModel)
+{
+    if (m_subvolumeModel != nullptr) {
+        disconnect(m_subvolumeModel, nullptr, this, nullptr);
+    }
+
+    // These are connected before the base class connects its own handlers so the index is already updated or marked as out
+    // of date when the base class filters the changed rows
+    m_subvolumeModel = qobject_cast<SubvolumeModel *>(sourceModel);
+    if (m_subvolumeModel != nullptr) {
+        connect(m_subvolumeModel, &QAbstractItemModel::dataChanged, this, &SubvolumeFilterModel::sourceDataChanged);
+        connect(m_subvolumeModel, &QAbstractItemModel::rowsInserted, this, &SubvolumeFilterModel::sourceRowsInserted);
+        connect(m_subvolumeModel, &QAbstractItemModel::rowsRemoved, this, &SubvolumeFilterModel::invalidateIndex);
+        connect(m_subvolumeModel, &QAbstractItemModel::modelReset, this, &SubvolumeFilterModel::invalidateIndex);
+        connect(m_subvolumeModel, &QAbstractItemModel::layoutChanged, this, &SubvolumeFilterModel::invalidateIndex);
+    }
+    invalidateIndex();
+
+    QSortFilterProxyModel::setSourceModel(sourceModel);
+}
+
 void SubvolumeFilterModel::setIncludeSnapshots(bool includeSnapshots)
 {
     if (m_includeSnapshots != includeSnapshots) {
@@ -201,17 +397,181 @@ void SubvolumeFilterModel::setIncludeContainer(bool includeContainer)
     }
 }
 
+void SubvolumeFilterModel::requestNameFilter(const QString &nameFilter)
+{
+    m_requestedNameFilter = nameFilter;
+    m_nameFilterTimer.start();
+}
+
+void SubvolumeFilterModel::setNameFilter(const QString &nameFilter)
+{
+    // Anything requested earlier is replaced by this filter
+    m_requestedNameFilter = nameFilter;
+    m_nameFilterTimer.stop();
+
+    if (m_nameFilter != nameFilter) {
+        m_nameFilter = nameFilter;
+        m_foldedNameFilter = nameFilter.toCaseFolded();
+        m_isMatchesStale = true;
+        invalidateFilter();
+    }
+}
+
+void SubvolumeFilterModel::applyMatches()
+{
+    // Another filter was requested or set while the names were compared
+    if (m_pendingNameFilter != m_requestedNameFilter) {
+        return;
+    }
+
+    // The rows changed while the names were compared so the result can't be used
+    if (m_pendingIndexVersion != m_indexVersion) {
+        setNameFilter(m_pendingNameFilter);
+        return;
+    }
+
+    m_nameFilter = m_pendingNameFilter;
+    m_foldedNameFilter = m_nameFilter.toCaseFolded();
+    m_matches = m_matchesWatcher.result();
+    m_matchesFilter = m_foldedNameFilter;
+    m_isMatchesStale = false;
+    invalidateFilter();
+}
+
+void SubvolumeFilterModel::applyRequestedNameFilter()
+{
+    const QString nameFilter = m_requestedNameFilter;
+    const QString foldedNameFilter = nameFilter.toCaseFolded();
+
+    // Small models, clearing the filter and an unchanged filter aren't worth a round trip through a worker thread
+    if (m_subvolumeModel == nullptr || foldedNameFilter.isEmpty() || nameFilter == m_nameFilter ||
+        m_subvolumeModel->rowCount() < ASYNC_FILTER_ROWS) {
+        setNameFilter(nameFilter);
+        return;
+    }
+
+    if (m_isIndexStale) {
+        buildIndex();
+    }
+
+    // The worker gets copies, which are cheap because they share the data until the index is changed on this thread
+    const bool narrow = isNarrowing(foldedNameFilter);
+    m_pendingNameFilter = nameFilter;
+    m_pendingIndexVersion = m_indexVersion;
+    m_matchesWatcher.setFuture(QtConcurrent::run(
+        [foldedNames = m_foldedNames, trigramRows = m_trigramRows, foldedNameFilter, narrow, previousMatches = m_matches]() {
+            return findMatches(foldedNames, trigramRows, foldedNameFilter, narrow ? &previousMatches : nullptr);
+        }));
+}
+
+void SubvolumeFilterModel::buildIndex() const
+{
+    TraceSpan span("SubvolumeFilterModel::buildIndex", "model");
+
+    m_foldedNames.clear();
+    m_trigramRows.clear();
+    indexRows(0);
+
+    span.setArg("rows", m_foldedNames.size());
+    span.setArg("trigrams", m_trigramRows.size());
+    m_isIndexStale = false;
+}
+
+void SubvolumeFilterModel::indexRows(int firstRow) const
+{
+    const int rowCount = m_subvolumeModel->rowCount();
+    m_foldedNames.reserve(rowCount);
+    for (int row = firstRow; row < rowCount; ++row) {
+        const QString name = m_subvolumeModel->subvolume(row).subvolName.toCaseFolded();
+        m_foldedNames.append(name);
+
+        for (int i = 0; i + 3 <= name.size(); ++i) {
+            QVector<int> &rows = m_trigramRows[trigramKey(name.constData() + i)];
+            // A trigram can repeat within a name but each row is only listed once
+            if (rows.isEmpty() || rows.last() != row) {
+                rows.append(row);
+            }
+        }
+    }
+}
+
+void SubvolumeFilterModel::invalidateIndex()
+{
+    m_indexVersion++;
+    m_isIndexStale = true;
+    m_isMatchesStale = true;
+    m_matchesFilter.clear();
+}
+
+bool SubvolumeFilterModel::isNarrowing(const QString &foldedNameFilter) const
+{
+    return !m_matchesFilter.isEmpty() && foldedNameFilter.contains(m_matchesFilter);
+}
+
+void SubvolumeFilterModel::sourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+    if (m_isIndexStale) {
+        return;
+    }
+
+    // Most updates don't rename the subvolume and leave the index as it is
+    for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+        if (row >= m_foldedNames.size() || m_foldedNames.at(row) != m_subvolumeModel->subvolume(row).subvolName.toCaseFolded()) {
+            invalidateIndex();
+            return;
+        }
+    }
+}
+
+void SubvolumeFilterModel::sourceRowsInserted(const QModelIndex &parent, int first, int last)
+{
+    Q_UNUSED(parent)
+    Q_UNUSED(last)
+
+    // Rows are appended when subvolumes are added so only the new rows need to be indexed
+    if (!m_isIndexStale && first == m_foldedNames.size()) {
+        indexRows(first);
+        m_indexVersion++;
+        m_isMatchesStale = true;
+        m_matchesFilter.clear();
+    } else {
+        invalidateIndex();
+    }
+}
+
+void SubvolumeFilterModel::updateMatches() const
+{
+    if (m_isIndexStale) {
+        buildIndex();
+    }
+
+    const QBitArray *previousMatches = isNarrowing(m_foldedNameFilter) ? &m_matches : nullptr;
+    m_matches = findMatches(m_foldedNames, m_trigramRows, m_foldedNameFilter, previousMatches);
+    m_matchesFilter = m_foldedNameFilter;
+    m_isMatchesStale = false;
+}
+
 bool SubvolumeFilterModel::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
 {
-    QModelIndex nameIdx = sourceModel()->index(sourceRow, static_cast<int>(SubvolumeModel::Column::Name), sourceParent);
-    const QString &name = sourceModel()->data(nameIdx).toString();
+    if (m_subvolumeModel == nullptr) {
+        return QSortFilterProxyModel::filterAcceptsRow(sourceRow, sourceParent);
+    }
 
-    if (!m_includeSnapshots && (Btrfs::isSnapper(name) || Btrfs::isTimeshift(name))) {
+    const SubvolumeModel::Kinds kinds = m_subvolumeModel->kinds(sourceRow);
+    if (!m_includeSnapshots && (kinds & (SubvolumeModel::IsSnapper | SubvolumeModel::IsTimeshift))) {
         return false;
     }
-    if (!m_includeContainer && Btrfs::isContainer(name)) {
+    if (!m_includeContainer && kinds.testFlag(SubvolumeModel::IsContainer)) {
         return false;
     }
 
-    return QSortFilterProxyModel::filterAcceptsRow(sourceRow, sourceParent);
+    if (m_foldedNameFilter.isEmpty()) {
+        return true;
+    }
+
+    if (m_isMatchesStale) {
+        updateMatches();
+    }
+
+    return sourceRow < m_matches.size() && m_matches.testBit(sourceRow);
 }
@@ -4,8 +4,13 @@
 #include "util/Btrfs.h"
 
 #include <QAbstractTableModel>
+#include <QBitArray>
+#include <QFutureWatcher>
+#include <QHash>
 #include <QMutex>
+#include <QPair>
 #include <QSortFilterProxyModel>
+#include <QTimer>
 
 class SubvolumeModel : public QAbstractTableModel {
     Q_OBJECT
@@ -29,6 +34,10 @@ class SubvolumeModel : public QAbstractTableModel {
 
     enum Role { Sort = Qt::UserRole };
 
+    // How a subvolume is classified from its name, computed once when the subvolume is added to the model
+    enum Kind { IsSnapper = 0x1, IsTimeshift = 0x2, IsContainer = 0x4, IsBackup = 0x8 };
+    Q_DECLARE_FLAGS(Kinds, Kind)
+
     explicit SubvolumeModel(QObject *parent = nullptr) : QAbstractTableModel(parent) {}
 
     // Basic model functions
@@ -44,6 +53,13 @@ class SubvolumeModel : public QAbstractTableModel {
      */
     const Subvolume &subvolume(int row) const;
 
+    /**
+     * @brief Returns the classification of the Subvolume at a given row
+     * @param row - A row of the Subvolume
+     * @return The Kinds which apply to the Subvolume at that row
+     */
+    Kinds kinds(int row) const;
+
     /**
      * @brief Populates the model using @p subvolData and @p subvolSize
      * @param subvolData - A map of Subvolumes with subvolId as the key
@@ -57,6 +73,15 @@ class SubvolumeModel : public QAbstractTableModel {
      */
     void addSubvolume(const Subvolume &subvol);
 
+    /**
+     * @brief Applies the changes from reloading the subvolumes of a single filesystem
+     *
+     * Rows are inserted, changed and removed individually instead of resetting the model so attached views keep their
+     * selection and scroll position and the proxy only refilters the affected rows.
+     * @param delta - The SubvolumeDelta returned from Btrfs::loadSubvols
+     */
+    void applyDelta(const SubvolumeDelta &delta);
+
     /**
      * @brief Updates an existing Subvolume in the model
      * @param subvol - A Subvolume to update
@@ -64,12 +89,35 @@ class SubvolumeModel : public QAbstractTableModel {
     void updateSubvolume(const Subvolume &subvol);
 
   private:
+    /**
+     * @brief Rebuilds the row index for every row from @p firstRow to the end of m_data
+     * @param firstRow - The first row whose position may have changed
+     */
+    void reindex(int firstRow);
+
     // Holds the data for the model
     QVector<Subvolume> m_data;
+    // The classification of every entry in m_data
+    QVector<Kinds> m_kinds;
+    // Maps the filesystem UUID and subvolume id of every entry in m_data to its row
+    QHash<QPair<QString, uint64_t>, int> m_rows;
     // Used to ensure only one model update runs at a time
     QMutex m_updateMutex;
 };
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(SubvolumeModel::Kinds)
+
+/**
+ * @brief The SubvolumeFilterModel class filters a SubvolumeModel by name and by the kind of subvolume
+ *
+ * The name filter is a case insensitive substring match.  Rather than comparing every name on every change of the
+ * filter, the rows containing each trigram of the case folded names are indexed and only the rows listed for the
+ * rarest trigram of the filter are compared.  The index is built on first use and again after the source model changes.
+ *
+ * A filter which contains the previous one can only narrow the result so only the rows accepted by the previous filter
+ * are compared again, any other change starts from the rows of the index.  requestNameFilter() is meant to be connected
+ * to a text field, it waits for typing to pause and compares the names of large models on a worker thread.
+ */
 class SubvolumeFilterModel : public QSortFilterProxyModel {
     Q_OBJECT
   public:
@@ -77,17 +125,112 @@ class SubvolumeFilterModel : public QSortFilterProxyModel {
 
     bool includeSnapshots() const;
     bool includeContainer() const;
+    QString nameFilter() const;
+
+    /**
+     * @brief Sets the source model, which must be a SubvolumeModel
+     */
+    void setSourceModel(QAbstractItemModel *sourceModel) override;
 
   public slots:
     void setIncludeSnapshots(bool includeSnapshots);
     void setIncludeContainer(bool includeContainer);
 
+    /**
+     * @brief Only accepts the subvolumes whose name contains @p nameFilter, ignoring case
+     * @param nameFilter - The text to look for, an empty string accepts every name
+     */
+    void setNameFilter(const QString &nameFilter);
+
+    /**
+     * @brief Applies @p nameFilter once no other filter has been requested for a short time
+     *
+     * The names are compared on a worker thread when the source model is large and the filter is applied when the
+     * comparison finishes, unless another filter was requested in the meantime.
+     * @param nameFilter - The text to look for, an empty string accepts every name
+     */
+    void requestNameFilter(const QString &nameFilter);
+
   protected:
     bool filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const override;
 
   private:
+    /**
+     * @brief Applies the filter from the worker thread if it is still the one requested
+     */
+    void applyMatches();
+
+    /**
+     * @brief Applies the last filter passed to requestNameFilter() once typing has paused
+     */
+    void applyRequestedNameFilter();
+
+    /**
+     * @brief Builds the trigram index over the names in the source model
+     */
+    void buildIndex() const;
+
+    /**
+     * @brief Checks if the rows matching @p foldedNameFilter are a subset of the current matches
+     * @param foldedNameFilter - The case folded name filter
+     * @return True if only the rows in m_matches need to be compared
+     */
+    bool isNarrowing(const QString &foldedNameFilter) const;
+
+    /**
+     * @brief Adds the source rows from @p firstRow to the end to the index
+     */
+    void indexRows(int firstRow) const;
+
+    /**
+     * @brief Marks the index and the matching rows as out of date after the source model changed
+     */
+    void invalidateIndex();
+
+    /**
+     * @brief Keeps the index when the changed rows weren't renamed
+     */
+    void sourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+
+    /**
+     * @brief Indexes the inserted rows when they were appended, otherwise invalidates the index
+     */
+    void sourceRowsInserted(const QModelIndex &parent, int first, int last);
+
+    /**
+     * @brief Finds the rows whose name contains the name filter, building the index first if needed
+     */
+    void updateMatches() const;
+
+    SubvolumeModel *m_subvolumeModel = nullptr;
     bool m_includeSnapshots = false;
     bool m_includeContainer = false;
+    QString m_nameFilter;
+    // The case folded name filter
+    QString m_foldedNameFilter;
+
+    // The last filter passed to requestNameFilter() or setNameFilter()
+    QString m_requestedNameFilter;
+    // Restarted by each call to requestNameFilter()
+    QTimer m_nameFilterTimer;
+    // The comparison running on a worker thread, the filter it is for and the index version it started from
+    QFutureWatcher<QBitArray> m_matchesWatcher;
+    QString m_pendingNameFilter;
+    int m_pendingIndexVersion = 0;
+    // Changes whenever the source rows change so results computed from older rows are discarded
+    int m_indexVersion = 0;
+
+    // The index is rebuilt lazily from filterAcceptsRow() so it is mutable
+    mutable bool m_isIndexStale = true;
+    mutable bool m_isMatchesStale = true;
+    // The case folded filter m_matches holds the result of, empty if the source rows changed since
+    mutable QString m_matchesFilter;
+    // The case folded name of every source row
+    mutable QVector<QString> m_foldedNames;
+    // The source rows, in ascending order, whose folded name contains each trigram
+    mutable QHash<quint64, QVector<int>> m_trigramRows;
+    // The source rows whose name contains the name filter
+    mutable QBitArray m_matches;
 };
 
 #endif // SUBVOLMODEL_H
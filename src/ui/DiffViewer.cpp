@@ -1,9 +1,46 @@
 #include "ui/DiffViewer.h"
-#include "util/System.h"
+#include "util/Btrfs.h"
 
 #include <QDialog>
 #include <QDir>
 #include <QMessageBox>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+/**
+ * @brief Returns true if something exists at @p path, a symlink counts even if it is dangling
+ */
+static bool pathExists(const QString &path)
+{
+    // Only the file type is asked for and cached attributes are fine, so this never waits on the filesystem
+    struct statx stx;
+    return statx(AT_FDCWD, path.toUtf8().constData(), AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC, STATX_TYPE, &stx) == 0;
+}
+
+/**
+ * @brief What was found out about the file in one snapshot without reading it
+ */
+struct SnapshotFile {
+    bool exists = false;
+    // The same for the snapshots holding the same version of the file or empty if it is unknown
+    QByteArray contentKey;
+};
+
+/**
+ * @brief Checks for the file at @p path and gets its content key if it is there
+ */
+static SnapshotFile probeSnapshotFile(const QString &path)
+{
+    SnapshotFile file;
+    file.exists = pathExists(path);
+    if (file.exists) {
+        file.contentKey = Btrfs::fileExtentKey(path);
+    }
+    return file;
+}
 
 DiffViewer::DiffViewer(Snapper *snapper, const QString &rootPath, const QString &filePath, const QString &uuid, QWidget *parent)
     : QDialog(parent), m_ui(new Ui::DiffViewer), m_snapper(snapper), m_uuid(uuid)
@@ -15,6 +52,12 @@ DiffViewer::DiffViewer(Snapper *snapper, const QString &rootPath, const QString
 
     m_twSnapshot = m_ui->tableWidget_snapshotList;
 
+    connect(&m_diffWatcher, &QFutureWatcher<DiffResult>::finished, this, &DiffViewer::diffFinished);
+    connect(m_ui->pushButton_previousHunk, &QPushButton::clicked, m_ui->listView_diff, &DiffView::previousHunk);
+    connect(m_ui->pushButton_nextHunk, &QPushButton::clicked, m_ui->listView_diff, &DiffView::nextHunk);
+
+    m_ui->listView_diff->setMessage(tr("Select a snapshot from the left to see the diff"));
+
     // We will need the target path for both diffs and restores
     m_targetPath = m_snapper->findTargetPath(rootPath, filePath, uuid);
 
@@ -39,10 +82,14 @@ void DiffViewer::on_pushButton_restore_clicked()
         return;
     }
 
+    // The target changed so none of the cached diffs are valid anymore, including one that is still running
+    m_diffCache.clear();
+    m_pendingDiffPath.clear();
+    on_tableWidget_snapshotList_itemSelectionChanged();
+
     QMessageBox::information(this, tr("Restore File"), tr("The file was successfully restored"));
 }
 
-#include <QDebug>
 void DiffViewer::LoadSnapshots(const QString &rootPath, const QString &filePath)
 {
     QDir snapshotDir(rootPath);
@@ -51,10 +98,20 @@ void DiffViewer::LoadSnapshots(const QString &rootPath, const QString &filePath)
 
     static QRegularExpression re("\\/[0-9]*\\/snapshot$");
     const QStringList subvolSplit = rootPath.split(re);
-    const QDir stemPath(subvolSplit.at(0));
-    const QString wildcardPath = QDir::cleanPath(stemPath.canonicalPath() + "/*/snapshot/" + relPath).replace(" ", "\\ ");
-
-    const QStringList resultList = System::runCmd("ls " + wildcardPath, false).output.split("\n");
+    const QString stemPath = QDir(subvolSplit.at(0)).canonicalPath();
+
+    // The snapshots and their metadata are already loaded so each one only needs a stat to see if it has the file and
+    // a map of its extents to tell the versions apart
+    const QVector<SnapperSubvolume> snapshots = m_snapper->siblingSnapshots(rootPath, m_uuid);
+    QStringList snapshotFiles;
+    snapshotFiles.reserve(snapshots.size());
+    for (const SnapperSubvolume &snapshot : snapshots) {
+        snapshotFiles.append(
+            QDir::cleanPath(stemPath + QDir::separator() + QString::number(snapshot.snapshotNum) + "/snapshot/" + relPath));
+    }
+    const QVector<SnapshotFile> probes = QtConcurrent::blockingMapped<QVector<SnapshotFile>>(snapshotFiles, probeSnapshotFile);
+    const int fileCount =
+        static_cast<int>(std::count_if(probes.cbegin(), probes.cend(), [](const SnapshotFile &probe) { return probe.exists; }));
 
     // Clear the table and set the headers
     m_twSnapshot->clear();
@@ -65,75 +122,115 @@ void DiffViewer::LoadSnapshots(const QString &rootPath, const QString &filePath)
     m_twSnapshot->setHorizontalHeaderItem(DiffColumn::filePath, new QTableWidgetItem(tr("File Path")));
     m_twSnapshot->setColumnHidden(DiffColumn::rootPath, true);
     m_twSnapshot->setColumnHidden(DiffColumn::filePath, true);
-    m_twSnapshot->setRowCount(resultList.count());
+    m_twSnapshot->setRowCount(fileCount);
 
     // We need to the locale for displaying the date/time
     QLocale locale = QLocale::system();
 
+    const QString selectedFile = QDir::cleanPath(filePath);
     int row = 0;
 
-    for (const QString &result : resultList) {
-        const QString endPath = stemPath.relativeFilePath(result);
-
-        // Find the snapshot number part of the path
-        const QString snapshotNum = endPath.split("/").at(0);
-
-        // Find the rootPath
-        const QString thisRootPath = QDir::cleanPath(stemPath.canonicalPath() + QDir::separator() + endPath.split(relPath).at(0));
-
-        // Get the date
-        const QString metaFileName =
-            QDir::cleanPath(stemPath.canonicalPath() + QDir::separator() + snapshotNum + QDir::separator() + "info.xml");
-        const QString date = locale.toString(Snapper::readSnapperMeta(metaFileName).time, QLocale::ShortFormat);
-
-        if (snapshotNum.isEmpty() || result.isEmpty() || thisRootPath.isEmpty()) {
+    for (int i = 0; i < snapshots.size(); i++) {
+        if (!probes.at(i).exists) {
             continue;
         }
 
+        const SnapperSubvolume &snapshot = snapshots.at(i);
+        const QString &snapshotFile = snapshotFiles.at(i);
+        const QString thisRootPath = QDir::cleanPath(stemPath + QDir::separator() + QString::number(snapshot.snapshotNum) + "/snapshot");
+
         // Populate the row in the table
-        QTableWidgetItem *number = new QTableWidgetItem(snapshotNum.toInt());
-        number->setData(Qt::DisplayRole, snapshotNum.toInt());
+        QTableWidgetItem *number = new QTableWidgetItem();
+        number->setData(Qt::DisplayRole, snapshot.snapshotNum);
+        number->setData(Qt::UserRole, probes.at(i).contentKey);
         m_twSnapshot->setItem(row, DiffColumn::num, number);
-        m_twSnapshot->setItem(row, DiffColumn::dateTime, new QTableWidgetItem(date));
+        m_twSnapshot->setItem(row, DiffColumn::dateTime, new QTableWidgetItem(locale.toString(snapshot.time, QLocale::ShortFormat)));
         m_twSnapshot->setItem(row, DiffColumn::rootPath, new QTableWidgetItem(thisRootPath));
-        m_twSnapshot->setItem(row, DiffColumn::filePath, new QTableWidgetItem(result.trimmed()));
+        m_twSnapshot->setItem(row, DiffColumn::filePath, new QTableWidgetItem(snapshotFile));
 
-        if (result.trimmed() == filePath) {
+        if (snapshotFile == selectedFile) {
             m_twSnapshot->selectRow(row);
         }
 
         row++;
-
-        qDebug() << relPath << subvolSplit.at(0) << Qt::endl;
     }
     m_twSnapshot->resizeColumnsToContents();
     m_twSnapshot->sortItems(DiffColumn::num, Qt::DescendingOrder);
+    updateHiddenRows();
 }
 
 void DiffViewer::on_tableWidget_snapshotList_itemSelectionChanged()
 {
-    const QString filePath = m_twSnapshot->item(m_twSnapshot->currentRow(), DiffColumn::filePath)->text();
-    const QStringList diffOutput = System::runCmd("diff", {"-u", m_targetPath, filePath}, false).output.split("\n");
+    const QTableWidgetItem *item = m_twSnapshot->item(m_twSnapshot->currentRow(), DiffColumn::filePath);
+    if (item == nullptr) {
+        return;
+    }
 
-    if (diffOutput.isEmpty() || diffOutput.at(0).isEmpty()) {
-        m_ui->textEdit_diff->setText(tr("There are no differences between the selected files"));
+    const QString filePath = item->text();
+    const auto cached = m_diffCache.constFind(qMakePair(filePath, m_targetPath));
+    if (cached != m_diffCache.constEnd()) {
+        showDiff(cached.value());
         return;
     }
 
-    // Get a copy of the palette before we start changing colors
-    QPalette defaultPalette = m_ui->textEdit_diff->palette();
-
-    // Show the diff
-    m_ui->textEdit_diff->clear();
-    for (const QString &line : diffOutput) {
-        // Colorize the output for lines added or removed
-        if (line.startsWith("+")) {
-            m_ui->textEdit_diff->setTextColor(Qt::darkGreen);
-        } else if (line.startsWith("-")) {
-            m_ui->textEdit_diff->setTextColor(Qt::red);
-        }
+    m_ui->listView_diff->setMessage(tr("Comparing the selected files..."));
+
+    // Only one comparison runs at a time, whichever file is selected when it finishes is compared next
+    if (m_diffWatcher.isRunning()) {
+        return;
+    }
+
+    m_pendingDiffPath = filePath;
+    m_diffWatcher.setFuture(
+        QtConcurrent::run([targetPath = m_targetPath, filePath]() { return Diff::compareFiles(targetPath, filePath); }));
+}
+
+void DiffViewer::diffFinished()
+{
+    if (!m_pendingDiffPath.isEmpty()) {
+        m_diffCache.insert(qMakePair(m_pendingDiffPath, m_targetPath), m_diffWatcher.result());
+    }
+
+    // Either shows the result just cached or compares the file selected while this one was running
+    on_tableWidget_snapshotList_itemSelectionChanged();
+}
 
-        m_ui->textEdit_diff->append(line);
-        m_ui->textEdit_diff->setTextColor(defaultPalette.text().color());
+void DiffViewer::showDiff(const DiffResult &result)
+{
+    switch (result.status) {
+    case DiffResult::Status::Identical:
+        m_ui->listView_diff->setMessage(tr("There are no differences between the selected files"));
+        return;
+    case DiffResult::Status::Binary:
+        m_ui->listView_diff->setMessage(tr("The selected files are binary and they differ"));
+        return;
+    case DiffResult::Status::Failed:
+        m_ui->listView_diff->setMessage(result.error);
+        return;
+    case DiffResult::Status::Different:
+        break;
+    }
+
+    m_ui->listView_diff->setDiff(result.lines);
+}
+
+void DiffViewer::updateHiddenRows()
+{
+    const bool isChangesOnly = m_ui->checkBox_distinctVersions->isChecked();
+
+    // Walk the snapshots oldest first so the first snapshot holding each version is the one left showing
+    QVector<QPair<uint, int>> rows;
+    rows.reserve(m_twSnapshot->rowCount());
+    for (int row = 0; row < m_twSnapshot->rowCount(); row++) {
+        rows.append({m_twSnapshot->item(row, DiffColumn::num)->data(Qt::DisplayRole).toUInt(), row});
+    }
+    std::sort(rows.begin(), rows.end());
+
+    QByteArray previousKey;
+    for (const QPair<uint, int> &row : qAsConst(rows)) {
+        // An unknown key is never the same version so those snapshots are always shown
+        const QByteArray key = m_twSnapshot->item(row.second, DiffColumn::num)->data(Qt::UserRole).toByteArray();
+        m_twSnapshot->setRowHidden(row.second, isChangesOnly && !key.isEmpty() && key == previousKey);
+        previousKey = key;
     }
 }
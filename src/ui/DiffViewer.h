@@ -1,9 +1,14 @@
 #ifndef DIFFVIEWER_H
 #define DIFFVIEWER_H
 
+#include "util/Diff.h"
 #include "util/Snapper.h"
 #include "ui_DiffViewer.h"
 
+#include <QFutureWatcher>
+#include <QHash>
+#include <QPair>
+
 enum DiffColumn { num, dateTime, rootPath, filePath };
 
 namespace Ui {
@@ -24,12 +29,18 @@ class DiffViewer : public QDialog {
   private slots:
     void on_pushButton_close_clicked() { this->close(); }
     void on_pushButton_restore_clicked();
+    void on_checkBox_distinctVersions_toggled() { updateHiddenRows(); }
 
     /**
-     * @brief When a selection changes in the table, update the diff textEdit widget
+     * @brief When a selection changes in the table, update the diff view
      */
     void on_tableWidget_snapshotList_itemSelectionChanged();
 
+    /**
+     * @brief Caches the diff which finished in the background, then shows the diff of the selected snapshot
+     */
+    void diffFinished();
+
   private:
     Ui::DiffViewer *m_ui;
     Snapper *m_snapper;
@@ -38,6 +49,12 @@ class DiffViewer : public QDialog {
     // This a convenience pointer to m_ui->tableWidget_snapshotList to improve readability
     QTableWidget *m_twSnapshot;
     QString m_uuid;
+    // Compares the files off the GUI thread
+    QFutureWatcher<DiffResult> m_diffWatcher;
+    // The file in the snapshot m_diffWatcher is comparing against m_targetPath, cleared when its result is out of date
+    QString m_pendingDiffPath;
+    // The diffs already computed keyed by the snapshot file and target file
+    QHash<QPair<QString, QString>, DiffResult> m_diffCache;
 
     /**
      * @brief Finds all the snapshots that contain the file and populated the grid
@@ -45,6 +62,17 @@ class DiffViewer : public QDialog {
      * @param filePath - The absolute path to the file selected within the snapshot
      */
     void LoadSnapshots(const QString &rootPath, const QString &filePath);
+
+    /**
+     * @brief Displays a diff in the diff view
+     * @param result - The comparison of the target file with the selected snapshot file
+     */
+    void showDiff(const DiffResult &result);
+
+    /**
+     * @brief Hides the snapshots holding the same version of the file as the snapshot before them when only changes are shown
+     */
+    void updateHiddenRows();
 };
 
 #endif // DIFFVIEWER_H
@@ -1,4 +1,5 @@
 #include "ui/MainWindow.h"
+#include "model/SnapperModel.h"
 #include "model/SubvolModel.h"
 #include "ui/FileBrowser.h"
 #include "ui/RestoreConfirmDialog.h"
@@ -6,22 +7,25 @@
 #include "ui_MainWindow.h"
 #include "util/Btrfs.h"
 #include "util/BtrfsMaintenance.h"
+#include "util/BtrfsMonitor.h"
 #include "util/Snapper.h"
 #include "util/System.h"
 
+#include <QApplication>
 #include <QDebug>
+#include <QFutureWatcher>
 #include <QInputDialog>
 #include <QMenu>
 #include <QMessageBox>
-#include <QTimer>
-
-namespace {
-enum class SnapperRestoreTableColumn { Number, Subvolume, DateTime, Type, Description };
-
-}
+#include <QSortFilterProxyModel>
+#include <QStatusBar>
+#include <QtConcurrent>
 
 constexpr const char *PARTITION_ROOT_TEXT = "Partition root";
 
+// The number of rows measured when sizing the columns of the snapper grids, the visible rows are always measured first
+constexpr int SNAPPER_GRID_SIZE_SAMPLE = 100;
+
 /**
  * @brief cleanTargetSubvol Clean the PARTITION_ROOT_TEXT from the subvol name
  * @param subvol The subvol text to clean
@@ -46,9 +50,53 @@ static void setListWidgetSelections(const QStringList &items, QListWidget *listW
     }
 }
 
+/**
+ * @brief Calls @p callback on @p context's thread with the result of @p future once it has finished
+ * @param future - The QFuture to wait for
+ * @param context - The QObject that owns the watcher, the callback is dropped if it is destroyed first
+ * @param callback - A callable which accepts the result of @p future
+ */
+template <typename T, typename Callback> static void onFinished(const QFuture<T> &future, QObject *context, Callback callback)
+{
+    auto *watcher = new QFutureWatcher<T>(context);
+    QObject::connect(watcher, &QFutureWatcher<T>::finished, context, [watcher, callback]() {
+        callback(watcher->result());
+        watcher->deleteLater();
+    });
+    watcher->setFuture(future);
+}
+
+/**
+ * @brief Calls @p callback on @p context's thread once @p future has finished
+ * @param future - The QFuture to wait for
+ * @param context - The QObject that owns the watcher, the callback is dropped if it is destroyed first
+ * @param callback - A callable which takes no arguments
+ */
+template <typename Callback> static void onFinished(const QFuture<void> &future, QObject *context, Callback callback)
+{
+    auto *watcher = new QFutureWatcher<void>(context);
+    QObject::connect(watcher, &QFutureWatcher<void>::finished, context, [watcher, callback]() {
+        callback();
+        watcher->deleteLater();
+    });
+    watcher->setFuture(future);
+}
+
+/**
+ * @brief Formats a duration for display
+ * @param seconds - The duration in seconds
+ * @return The duration as hours, minutes and seconds
+ */
+static QString formatDuration(qint64 seconds)
+{
+    return QString("%1:%2:%3").arg(seconds / 3600).arg(seconds / 60 % 60, 2, 10, QChar('0')).arg(seconds % 60, 2, 10, QChar('0'));
+}
+
 MainWindow::MainWindow(Btrfs *btrfs, BtrfsMaintenance *btrfsMaintenance, Snapper *snapper, QWidget *parent)
     : QMainWindow(parent), m_ui(new Ui::MainWindow), m_btrfs(btrfs), m_btrfsMaint(btrfsMaintenance), m_snapper(snapper)
 {
+    m_startupTimer.start();
+
     m_ui->setupUi(this);
     // Always start on the BTRFS tab, regardless what is the currentIndex in the .ui file
     m_ui->tabWidget_mainWindow->setCurrentWidget(m_ui->tab_btrfs);
@@ -63,22 +111,33 @@ MainWindow::MainWindow(Btrfs *btrfs, BtrfsMaintenance *btrfsMaintenance, Snapper
     m_hasBtrfsmaintenance = btrfsMaintenance != nullptr;
 
     m_subvolumeModel = new SubvolumeModel(this);
-    m_subvolumeModel->load(m_btrfs->filesystems());
     m_subvolumeFilterModel = new SubvolumeFilterModel(this);
     m_subvolumeFilterModel->setSourceModel(m_subvolumeModel);
 
-    connect(m_ui->lineEdit_subvolFilter, &QLineEdit::textChanged, m_subvolumeFilterModel, &SubvolumeFilterModel::setFilterFixedString);
+    m_snapperSnapshotModel = new SnapperSnapshotModel(this);
+    m_snapperSnapshotSortModel = new QSortFilterProxyModel(this);
+    m_snapperSnapshotSortModel->setSourceModel(m_snapperSnapshotModel);
+    m_snapperSnapshotSortModel->setSortRole(SnapperSnapshotModel::Role::Sort);
+    m_snapperSubvolumeModel = new SnapperSubvolumeModel(this);
+    m_snapperSubvolumeSortModel = new QSortFilterProxyModel(this);
+    m_snapperSubvolumeSortModel->setSourceModel(m_snapperSubvolumeModel);
+    m_snapperSubvolumeSortModel->setSortRole(SnapperSubvolumeModel::Role::Sort);
+
+    connect(m_ui->lineEdit_subvolFilter, &QLineEdit::textChanged, m_subvolumeFilterModel, &SubvolumeFilterModel::requestNameFilter);
     connect(m_ui->checkBox_subvolIncludeSnapshots, &QCheckBox::toggled, m_subvolumeFilterModel, &SubvolumeFilterModel::setIncludeSnapshots);
     connect(m_ui->checkBox_subvolIncludeContainer, &QCheckBox::toggled, m_subvolumeFilterModel, &SubvolumeFilterModel::setIncludeContainer);
 
-    // timers for filesystem operations
-    m_balanceTimer = new QTimer(this);
-    m_scrubTimer = new QTimer(this);
-    connect(m_balanceTimer, &QTimer::timeout, this, &MainWindow::btrfsBalanceStatusUpdateUI);
-    connect(m_scrubTimer, &QTimer::timeout, this, &MainWindow::btrfsScrubStatusUpdateUI);
+    // Progress of the filesystem operations
+    m_btrfsMonitor = new BtrfsMonitor(this);
+    connect(m_btrfsMonitor, &BtrfsMonitor::balanceProgressChanged, this, &MainWindow::btrfsBalanceStatusUpdateUI);
+    connect(m_btrfsMonitor, &BtrfsMonitor::scrubProgressChanged, this, &MainWindow::btrfsScrubStatusUpdateUI);
 
     setup();
     this->setWindowTitle(QCoreApplication::applicationName());
+    reportStartupPhase("Window setup", m_startupTimer.elapsed());
+
+    // Only the data for the visible tab is loaded now, the other tabs are populated when they are first shown
+    populateTab(m_ui->tabWidget_mainWindow->currentWidget());
 }
 
 MainWindow::~MainWindow() { delete m_ui; }
@@ -138,47 +197,95 @@ void MainWindow::bmRefreshMountpoints()
     }
 }
 
-void MainWindow::btrfsBalanceStatusUpdateUI()
+void MainWindow::btrfsBalanceStatusUpdateUI(const BalanceProgress &progress)
 {
-    QString uuid = m_ui->comboBox_btrfsDevice->currentText();
-    QString balanceStatus = m_btrfs->balanceStatus(Btrfs::findAnyMountpoint(uuid));
-
-    // if balance is running currently, make sure you can stop it and we monitor progress
-    if (!balanceStatus.contains("No balance found")) {
+    // if balance is running currently, make sure you can stop it
+    if (progress.isRunning) {
         m_ui->pushButton_btrfsBalance->setText("Stop");
-        // update status to current balance operation status
-        m_ui->label_btrfsBalanceStatus->setText(balanceStatus);
-        // keep updating UI if it isn't already doing so
-        if (m_balanceTimer->timerId() == -1) {
-            m_balanceTimer->start();
+
+        QString status = progress.isPaused ? tr("Balance paused") : tr("Balance running");
+        status += ": " + tr("%1 of %2 chunks relocated (%3%), %4 considered")
+                             .arg(progress.completed)
+                             .arg(progress.expected)
+                             .arg(progress.percent(), 0, 'f', 1)
+                             .arg(progress.considered);
+        if (progress.etaSeconds >= 0) {
+            status += "\n" + tr("Estimated time remaining: %1").arg(formatDuration(progress.etaSeconds));
         }
+        m_ui->label_btrfsBalanceStatus->setText(status);
     } else {
-        // update status to reflect no balance running and stop timer
-        m_ui->label_btrfsBalanceStatus->setText("No balance running.");
+        m_ui->label_btrfsBalanceStatus->setText(tr("No balance running."));
         m_ui->pushButton_btrfsBalance->setText("Start");
-        m_balanceTimer->stop();
     }
 }
 
-void MainWindow::btrfsScrubStatusUpdateUI()
+void MainWindow::btrfsScrubStatusUpdateUI(const ScrubProgress &progress)
 {
-    QString uuid = m_ui->comboBox_btrfsDevice->currentText();
-    QString scrubStatus = m_btrfs->scrubStatus(Btrfs::findAnyMountpoint(uuid));
-
-    // update status to current scrub operation status
-    m_ui->label_btrfsScrubStatus->setText(scrubStatus);
-    // if scrub is running currently, make sure you can stop it and we monitor progress
-    if (scrubStatus.contains("ETA:")) {
+    // if scrub is running currently, make sure you can stop it
+    if (progress.isRunning) {
+        m_hasScrubSummary = false;
         m_ui->pushButton_btrfsScrub->setText("Stop");
-        if (m_scrubTimer->timerId() == -1) {
-            m_scrubTimer->start();
+
+        QString status = tr("Scrub running: %1 of %2 scrubbed (%3%)")
+                             .arg(System::toHumanReadable(progress.bytesScrubbed))
+                             .arg(System::toHumanReadable(progress.bytesToScrub))
+                             .arg(progress.percent(), 0, 'f', 1);
+        if (progress.bytesPerSecond > 0) {
+            status += "\n" + tr("Rate: %1/s").arg(System::toHumanReadable(static_cast<uint64_t>(progress.bytesPerSecond)));
+        }
+        if (progress.etaSeconds >= 0) {
+            status += "\n" + tr("Estimated time remaining: %1").arg(formatDuration(progress.etaSeconds));
         }
+        status += "\n" + tr("Errors: %1 (%2 corrected, %3 uncorrectable)")
+                             .arg(progress.errors)
+                             .arg(progress.correctedErrors)
+                             .arg(progress.uncorrectableErrors);
+        m_ui->label_btrfsScrubStatus->setText(status);
     } else {
-        m_scrubTimer->stop();
         m_ui->pushButton_btrfsScrub->setText("Start");
+
+        // The kernel doesn't keep the results of a finished scrub so the summary is read from btrfs once
+        if (!m_hasScrubSummary) {
+            m_hasScrubSummary = true;
+            const QString mountpoint = Btrfs::findAnyMountpoint(m_ui->comboBox_btrfsDevice->currentText());
+            onFinished(m_btrfs->scrubStatus(mountpoint), this,
+                       [this](const Result &result) { m_ui->label_btrfsScrubStatus->setText(result.output); });
+        }
     }
 }
 
+QFuture<void> MainWindow::loadBtrfsData()
+{
+    if (!m_isBtrfsLoadStarted) {
+        m_isBtrfsLoadStarted = true;
+        m_btrfsLoad = QtConcurrent::run([this]() {
+            QElapsedTimer timer;
+            timer.start();
+            m_btrfs->loadVolumes();
+            reportStartupPhase("Loading the btrfs data", timer.elapsed());
+        });
+    }
+
+    return m_btrfsLoad;
+}
+
+QFuture<void> MainWindow::loadSnapperData()
+{
+    if (!m_isSnapperLoadStarted) {
+        m_isSnapperLoadStarted = true;
+        // Snapper matches its snapshots against the subvolumes so it has to wait for the btrfs data
+        m_snapperLoad = QtConcurrent::run([this, btrfsLoad = loadBtrfsData()]() mutable {
+            btrfsLoad.waitForFinished();
+            QElapsedTimer timer;
+            timer.start();
+            m_snapper->load();
+            reportStartupPhase("Loading the snapper data", timer.elapsed());
+        });
+    }
+
+    return m_snapperLoad;
+}
+
 void MainWindow::loadSnapperUI()
 {
     // If snapper isn't installed, no need to continue
@@ -309,8 +416,9 @@ void MainWindow::populateBtrfsUi(const QString &uuid)
     }
 
     // filesystems operation section
-    btrfsBalanceStatusUpdateUI();
-    btrfsScrubStatusUpdateUI();
+    const QString mountpoint = Btrfs::findAnyMountpoint(uuid);
+    m_hasScrubSummary = false;
+    m_btrfsMonitor->setMountpoint(mountpoint);
 }
 
 void MainWindow::populateSnapperConfigSettings()
@@ -343,103 +451,79 @@ void MainWindow::populateSnapperConfigSettings()
 
 void MainWindow::populateSnapperGrid()
 {
-    // We need to the locale for displaying the date/time
-    const QLocale locale = QLocale::system();
-
     const QString config = m_ui->comboBox_snapperConfigs->currentText();
 
-    // Clear the table and set the headers
-    m_ui->tableWidget_snapperNew->clear();
-    m_ui->tableWidget_snapperNew->setColumnCount(5);
-    m_ui->tableWidget_snapperNew->setHorizontalHeaderItem(0, new QTableWidgetItem(tr("Number", "The number associated with a snapshot")));
-    m_ui->tableWidget_snapperNew->setHorizontalHeaderItem(1, new QTableWidgetItem(tr("Date/Time")));
-    m_ui->tableWidget_snapperNew->setHorizontalHeaderItem(2, new QTableWidgetItem(tr("Type")));
-    m_ui->tableWidget_snapperNew->setHorizontalHeaderItem(3, new QTableWidgetItem(tr("Cleanup")));
-    m_ui->tableWidget_snapperNew->setHorizontalHeaderItem(4, new QTableWidgetItem(tr("Description")));
-    m_ui->tableWidget_snapperNew->sortByColumn(0, Qt::DescendingOrder);
-    m_ui->tableWidget_snapperNew->setContextMenuPolicy(Qt::CustomContextMenu);
-
-    // Disabling sorting while populating the grid is required or the grid won't repopulate properly
-    m_ui->tableWidget_snapperNew->setSortingEnabled(false);
-
-    // Make sure there is something to populate
-    QVector<SnapperSnapshot> snapshots = m_snapper->snapshots(config);
-    if (snapshots.isEmpty()) {
-        return;
-    }
-
-    // Populate the table
-    m_ui->tableWidget_snapperNew->setRowCount(snapshots.size());
-    for (int i = 0; i < snapshots.size(); i++) {
-        // Ensure proper sorting of numbers and dates
-        QTableWidgetItem *number = new QTableWidgetItem(static_cast<int>(snapshots.at(i).number));
-        number->setData(Qt::DisplayRole, snapshots.at(i).number);
-        QTableWidgetItem *snapTime = new QTableWidgetItem(locale.toString(snapshots.at(i).time, QLocale::ShortFormat));
-        snapTime->setData(Qt::DisplayRole, snapshots.at(i).time);
+    m_snapperSnapshotModel->load(m_snapper->snapshots(config));
 
-        m_ui->tableWidget_snapperNew->setItem(i, 0, number);
-        m_ui->tableWidget_snapperNew->setItem(i, 1, snapTime);
-        m_ui->tableWidget_snapperNew->setItem(i, 2, new QTableWidgetItem(snapshots.at(i).type));
-        m_ui->tableWidget_snapperNew->setItem(i, 3, new QTableWidgetItem(snapshots.at(i).cleanup));
-        m_ui->tableWidget_snapperNew->setItem(i, 4, new QTableWidgetItem(snapshots.at(i).desc));
-    }
-
-    // Re-enable sorting and resize the colums to make everything fit
-    m_ui->tableWidget_snapperNew->setSortingEnabled(true);
-    m_ui->tableWidget_snapperNew->resizeColumnsToContents();
+    // Only a sample of the rows is measured, see SNAPPER_GRID_SIZE_SAMPLE
+    m_ui->tableView_snapperNew->resizeColumnsToContents();
 }
 
 void MainWindow::populateSnapperRestoreGrid()
 {
-    // We need to the locale for displaying the date/time
-    const QLocale locale = QLocale::system();
-
     // Get the name of the subvolume to list in the grid
-    QString config = cleanTargetSubvol(m_ui->comboBox_snapperSubvols->currentText());
+    const QString config = cleanTargetSubvol(m_ui->comboBox_snapperSubvols->currentText());
+
+    m_snapperSubvolumeModel->load(m_snapper->subvols(config));
 
-    // Clear the table and set the headers
-    m_ui->tableWidget_snapperRestore->clear();
-    m_ui->tableWidget_snapperRestore->setColumnCount(5);
-    m_ui->tableWidget_snapperRestore->setHorizontalHeaderItem((int)SnapperRestoreTableColumn::Number,
-                                                              new QTableWidgetItem(tr("Number", "The number associated with a snapshot")));
-    m_ui->tableWidget_snapperRestore->setHorizontalHeaderItem((int)SnapperRestoreTableColumn::Subvolume,
-                                                              new QTableWidgetItem(tr("Subvolume")));
-    m_ui->tableWidget_snapperRestore->setHorizontalHeaderItem((int)SnapperRestoreTableColumn::DateTime,
-                                                              new QTableWidgetItem(tr("Date/Time")));
-    m_ui->tableWidget_snapperRestore->setHorizontalHeaderItem((int)SnapperRestoreTableColumn::Type, new QTableWidgetItem(tr("Type")));
-    m_ui->tableWidget_snapperRestore->setHorizontalHeaderItem((int)SnapperRestoreTableColumn::Description,
-                                                              new QTableWidgetItem(tr("Description")));
-    m_ui->tableWidget_snapperRestore->sortByColumn(0, Qt::DescendingOrder);
-
-    // Disabling sorting while populating the grid is required or the grid won't repopulate properly - This must be Qt bug, right?
-    m_ui->tableWidget_snapperRestore->setSortingEnabled(false);
-
-    QVector<SnapperSubvolume> subvols = m_snapper->subvols(config);
-    // Make sure there is something to populate
-    if (subvols.isEmpty()) {
+    // Only a sample of the rows is measured, see SNAPPER_GRID_SIZE_SAMPLE
+    m_ui->tableView_snapperRestore->resizeColumnsToContents();
+}
+
+void MainWindow::populateTab(QWidget *tab)
+{
+    if (m_populatedTabs.contains(tab)) {
         return;
     }
 
-    // Populate the table
-    m_ui->tableWidget_snapperRestore->setRowCount(subvols.count());
-    for (int i = 0; i < subvols.count(); i++) {
-        const SnapperSubvolume &subvolume = subvols.at(i);
-        // Ensure proper sorting of numbers and dates
-        QTableWidgetItem *number = new QTableWidgetItem();
-        number->setData(Qt::DisplayRole, subvolume.snapshotNum);
-        QTableWidgetItem *snapTime = new QTableWidgetItem(locale.toString(subvolume.time, QLocale::ShortFormat));
-        snapTime->setData(Qt::DisplayRole, subvolume.time);
+    QElapsedTimer timer;
+    timer.start();
+    const QString tabName = m_ui->tabWidget_mainWindow->tabText(m_ui->tabWidget_mainWindow->indexOf(tab));
 
-        m_ui->tableWidget_snapperRestore->setItem(i, (int)SnapperRestoreTableColumn::Number, number);
-        m_ui->tableWidget_snapperRestore->setItem(i, (int)SnapperRestoreTableColumn::Subvolume, new QTableWidgetItem(subvolume.subvol));
-        m_ui->tableWidget_snapperRestore->setItem(i, (int)SnapperRestoreTableColumn::DateTime, snapTime);
-        m_ui->tableWidget_snapperRestore->setItem(i, (int)SnapperRestoreTableColumn::Type, new QTableWidgetItem(subvolume.type));
-        m_ui->tableWidget_snapperRestore->setItem(i, (int)SnapperRestoreTableColumn::Description, new QTableWidgetItem(subvolume.desc));
-    }
+    if (tab == m_ui->tab_btrfs || tab == m_ui->tab_subvolumes) {
+        m_populatedTabs.insert(tab);
+        setBusy(true);
+        onFinished(loadBtrfsData(), this, [this, tab, tabName, timer]() {
+            if (tab == m_ui->tab_btrfs) {
+                refreshBtrfsUi();
+            } else {
+                m_subvolumeModel->load(m_btrfs->filesystems());
+                refreshSubvolListUi();
+            }
+            reportStartupPhase("Populating the " + tabName + " tab", timer.elapsed());
+            setBusy(false);
+        });
+    } else if (tab == m_ui->tab_snapper_general || tab == m_ui->tab_snapper_settings) {
+        if (!m_hasSnapper) {
+            return;
+        }
 
-    // Re-enable sorting and resize the colums to make everything fit
-    m_ui->tableWidget_snapperRestore->setSortingEnabled(true);
-    m_ui->tableWidget_snapperRestore->resizeColumnsToContents();
+        // Both snapper tabs are filled from the same data so they are populated together
+        m_populatedTabs.insert(m_ui->tab_snapper_general);
+        m_populatedTabs.insert(m_ui->tab_snapper_settings);
+        refreshSnapperServices();
+        setBusy(true);
+        onFinished(loadSnapperData(), this, [this, tabName, timer]() {
+            loadSnapperUI();
+            if (m_snapper->configs().contains("root")) {
+                m_ui->comboBox_snapperConfigs->setCurrentText("root");
+            }
+            populateSnapperGrid();
+            populateSnapperRestoreGrid();
+            populateSnapperConfigSettings();
+            reportStartupPhase("Populating the " + tabName + " tab", timer.elapsed());
+            setBusy(false);
+        });
+    } else if (tab == m_ui->tab_btrfsmaintenance) {
+        if (!m_hasBtrfsmaintenance) {
+            return;
+        }
+
+        m_populatedTabs.insert(tab);
+        refreshSnapperServices();
+        populateBmTab();
+        reportStartupPhase("Populating the " + tabName + " tab", timer.elapsed());
+    }
 }
 
 void MainWindow::refreshBmUi()
@@ -451,8 +535,8 @@ void MainWindow::refreshBmUi()
 void MainWindow::refreshBtrfsUi()
 {
 
-    // Repopulate device selection combo box with detected btrfs filesystems.
-    const QStringList uuidList = Btrfs::listFilesystems();
+    // Repopulate device selection combo box with the btrfs filesystems that were loaded.
+    const QStringList uuidList = m_btrfs->filesystems().keys();
     for (const QString &uuid : uuidList) {
         if (m_ui->comboBox_btrfsDevice->findText(uuid) == -1) {
             m_ui->comboBox_btrfsDevice->addItem(uuid);
@@ -466,26 +550,26 @@ void MainWindow::refreshBtrfsUi()
 
 void MainWindow::refreshSnapperServices()
 {
-    const auto enabledUnits = System::findEnabledUnits();
-
-    // Loop through the checkboxes and change state to match
-    const QList<QCheckBox *> checkboxes =
-        m_ui->scrollArea_bm->findChildren<QCheckBox *>() + m_ui->groupBox_snapperUnits->findChildren<QCheckBox *>();
-    for (QCheckBox *checkbox : checkboxes) {
-        if (checkbox->property("actionType") == "service") {
-            checkbox->setChecked(enabledUnits.contains(checkbox->property("actionData").toString()));
+    onFinished(QtConcurrent::run(&System::findEnabledUnits), this, [this](const QStringList &enabledUnits) {
+        // Loop through the checkboxes and change state to match
+        const QList<QCheckBox *> checkboxes =
+            m_ui->scrollArea_bm->findChildren<QCheckBox *>() + m_ui->groupBox_snapperUnits->findChildren<QCheckBox *>();
+        for (QCheckBox *checkbox : checkboxes) {
+            if (checkbox->property("actionType") == "service") {
+                checkbox->setChecked(enabledUnits.contains(checkbox->property("actionData").toString()));
+            }
         }
-    }
+    });
 }
 
 void MainWindow::refreshSubvolListUi()
 {
     bool showQuota = false;
 
-    const auto filesystems = m_btrfs->listFilesystems();
-    for (const QString &uuid : filesystems) {
+    const auto filesystems = m_btrfs->filesystems();
+    for (const BtrfsFilesystem &filesystem : filesystems) {
         // Check to see if the size related colums should be hidden
-        if (Btrfs::isQuotaEnabled(Btrfs::findAnyMountpoint(uuid))) {
+        if (filesystem.isQuotaEnabled) {
             showQuota = true;
         }
     }
@@ -571,6 +655,28 @@ void MainWindow::restoreSnapshot(const QString &uuid, const QString &subvolume)
     }
 }
 
+QVector<SnapperSnapshot> MainWindow::selectedSnapperSnapshots() const
+{
+    QVector<SnapperSnapshot> snapshots;
+
+    const QModelIndexList rows = m_ui->tableView_snapperNew->selectionModel()->selectedRows();
+    for (const QModelIndex &index : rows) {
+        snapshots.append(m_snapperSnapshotModel->snapshot(m_snapperSnapshotSortModel->mapToSource(index).row()));
+    }
+
+    return snapshots;
+}
+
+const SnapperSubvolume *MainWindow::selectedSnapperSubvolume() const
+{
+    const QModelIndex index = m_snapperSubvolumeSortModel->mapToSource(m_ui->tableView_snapperRestore->currentIndex());
+    if (!index.isValid()) {
+        return nullptr;
+    }
+
+    return &m_snapperSubvolumeModel->subvolume(index.row());
+}
+
 void MainWindow::setup()
 {
 
@@ -605,24 +711,21 @@ void MainWindow::setup()
     m_ui->tableView_subvols->horizontalHeader()->setSectionResizeMode(SubvolumeModel::Column::ReadOnly, QHeaderView::ResizeToContents);
     m_ui->tableView_subvols->verticalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
 
-    // Populate the UI
-    refreshBtrfsUi();
-    if (m_hasSnapper) {
-        refreshSnapperServices();
-        loadSnapperUI();
-        if (m_snapper->configs().contains("root")) {
-            m_ui->comboBox_snapperConfigs->setCurrentText("root");
-        }
-        populateSnapperGrid();
-        populateSnapperRestoreGrid();
-        populateSnapperConfigSettings();
-    }
-
-    // Populate or hide btrfs maintenance tab depending on if system has btrfs maintenance units
-    if (m_hasBtrfsmaintenance) {
-        populateBmTab();
-    } else {
-        // Hide the btrfs maintenance tab
+    // Connect the snapper views, the rows have a uniform height and only a sample of them is measured for the column widths
+    // so the cost of showing a config is proportional to the visible rows rather than the number of snapshots
+    m_ui->tableView_snapperNew->setModel(m_snapperSnapshotSortModel);
+    m_ui->tableView_snapperNew->setContextMenuPolicy(Qt::CustomContextMenu);
+    m_ui->tableView_snapperNew->sortByColumn(SnapperSnapshotModel::Column::Number, Qt::DescendingOrder);
+    m_ui->tableView_snapperRestore->setModel(m_snapperSubvolumeSortModel);
+    m_ui->tableView_snapperRestore->sortByColumn(SnapperSubvolumeModel::Column::Number, Qt::DescendingOrder);
+    for (QTableView *view : {m_ui->tableView_snapperNew, m_ui->tableView_snapperRestore}) {
+        view->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+        view->horizontalHeader()->setResizeContentsPrecision(SNAPPER_GRID_SIZE_SAMPLE);
+        view->verticalHeader()->setResizeContentsPrecision(SNAPPER_GRID_SIZE_SAMPLE);
+    }
+
+    // Hide the btrfs maintenance tab if the system doesn't have btrfs maintenance units, the tabs are populated by populateTab()
+    if (!m_hasBtrfsmaintenance) {
         m_ui->tabWidget_mainWindow->setTabVisible(m_ui->tabWidget_mainWindow->indexOf(m_ui->tab_btrfsmaintenance), false);
     }
 }
@@ -712,18 +815,20 @@ void MainWindow::on_pushButton_btrfsBalance_clicked()
     // Stop or start balance depending on current operation
     if (m_ui->pushButton_btrfsBalance->text().contains("Stop")) {
         m_btrfs->stopBalanceRoot(uuid);
-        btrfsBalanceStatusUpdateUI();
     } else {
         m_btrfs->startBalanceRoot(uuid);
-        btrfsBalanceStatusUpdateUI();
     }
+    m_btrfsMonitor->poll();
 }
 
 void MainWindow::on_pushButton_btrfsRefreshData_clicked()
 {
-    m_btrfs->loadVolumes();
-    m_subvolumeModel->load(m_btrfs->filesystems());
-    refreshBtrfsUi();
+    setBusy(true);
+    onFinished(QtConcurrent::run([this]() { m_btrfs->loadVolumes(); }), this, [this]() {
+        m_subvolumeModel->load(m_btrfs->filesystems());
+        refreshBtrfsUi();
+        setBusy(false);
+    });
 
     m_ui->pushButton_btrfsRefreshData->clearFocus();
 }
@@ -735,27 +840,31 @@ void MainWindow::on_pushButton_btrfsScrub_clicked()
     // Stop or start scrub depending on current operation
     if (m_ui->pushButton_btrfsScrub->text().contains("Stop")) {
         m_btrfs->stopScrubRoot(uuid);
-        btrfsScrubStatusUpdateUI();
     } else {
         m_btrfs->startScrubRoot(uuid);
-        btrfsScrubStatusUpdateUI();
     }
+    m_btrfsMonitor->poll();
 }
 
 void MainWindow::on_pushButton_enableQuota_clicked()
 {
-    if (m_ui->comboBox_btrfsDevice->currentText().isEmpty()) {
+    const QString uuid = m_ui->comboBox_btrfsDevice->currentText();
+    if (uuid.isEmpty()) {
         return;
     }
-    const QString mountpoint = Btrfs::findAnyMountpoint(m_ui->comboBox_btrfsDevice->currentText());
-
-    if (!mountpoint.isEmpty() && m_btrfs->isQuotaEnabled(mountpoint)) {
-        Btrfs::setQgroupEnabled(mountpoint, false);
-    } else {
-        Btrfs::setQgroupEnabled(mountpoint, true);
-    }
-
-    setEnableQuotaButtonStatus();
+    const bool enable = !m_btrfs->filesystem(uuid).isQuotaEnabled;
+
+    setBusy(true);
+    onFinished(QtConcurrent::run([this, uuid, enable]() {
+                   Btrfs::setQgroupEnabled(Btrfs::findAnyMountpoint(uuid), enable);
+                   m_btrfs->loadQgroups(uuid);
+               }),
+               this, [this]() {
+                   m_subvolumeModel->load(m_btrfs->filesystems());
+                   refreshSubvolListUi();
+                   setEnableQuotaButtonStatus();
+                   setBusy(false);
+               });
 }
 
 void MainWindow::on_pushButton_snapperDeleteConfig_clicked()
@@ -1012,7 +1121,7 @@ void MainWindow::on_tableView_subvols_customContextMenuRequested(const QPoint &p
     }
 }
 
-void MainWindow::on_tableWidget_snapperNew_customContextMenuRequested(const QPoint &pos)
+void MainWindow::on_tableView_snapperNew_customContextMenuRequested(const QPoint &pos)
 {
     QMenu menu;
 
@@ -1031,7 +1140,7 @@ void MainWindow::on_tableWidget_snapperNew_customContextMenuRequested(const QPoi
     action = menu.addAction(tr("&Change description"));
     connect(action, &QAction::triggered, this, &MainWindow::on_toolButton_snapperChangeDescription_clicked);
 
-    menu.exec(m_ui->tableView_subvols->mapToGlobal(pos));
+    menu.exec(m_ui->tableView_snapperNew->viewport()->mapToGlobal(pos));
 }
 
 void MainWindow::on_toolButton_bmApply_clicked()
@@ -1132,16 +1241,17 @@ void MainWindow::on_toolButton_subvolDelete_clicked()
     }
 
     // Get all the rows that were selected
-    const QModelIndexList nameIndexes = m_ui->tableView_subvols->selectionModel()->selectedRows(SubvolumeModel::Column::Name);
-    const QModelIndexList uuidIndexes = m_ui->tableView_subvols->selectionModel()->selectedRows(SubvolumeModel::Column::FilesystemUuid);
+    const QModelIndexList indexes = m_ui->tableView_subvols->selectionModel()->selectedRows();
 
-    // Check for a snapper snapshot and ask if the metadata should be cleaned up if found
+    QVector<SubvolumeDeletion> deletions;
     bool hasSnapshot = false;
-    for (const auto &index : nameIndexes) {
-        if (Btrfs::isSnapper(index.data().toString())) {
-            hasSnapshot = true;
-            break;
-        }
+    for (const QModelIndex &index : indexes) {
+        const int row = m_subvolumeFilterModel->mapToSource(index).row();
+        const Subvolume &subvol = m_subvolumeModel->subvolume(row);
+        deletions.append({subvol.filesystemUuid, subvol.id, subvol.subvolName});
+
+        // Check for a snapper snapshot so we can ask if the metadata should be cleaned up
+        hasSnapshot = hasSnapshot || m_subvolumeModel->kinds(row).testFlag(SubvolumeModel::IsSnapper);
     }
 
     bool cleanupSnapper = false;
@@ -1151,79 +1261,83 @@ void MainWindow::on_toolButton_subvolDelete_clicked()
         cleanupSnapper = true;
     }
 
-    QSet<QString> uuids;
-
-    for (int i = 0; i < nameIndexes.count(); i++) {
-        QString subvol = nameIndexes.at(i).data().toString();
-        QString uuid = uuidIndexes.at(i).data().toString();
-
-        // Add the uuid to the set of uuids with subvolumes deleted
-        uuids.insert(uuid);
-
-        // Make sure the everything is good in the UI
-        if (subvol.isEmpty() || uuid.isEmpty()) {
-            continue;
-        }
-
-        // get the subvolid, if it isn't found abort
-        uint64_t subvolid = m_btrfs->subvolId(uuid, subvol);
-        if (subvolid == 0) {
-            displayError(tr("Failed to delete subvolume!") + "\n\n" + tr("Invalid subvolume ID"));
-            continue;
-        }
-
-        // ensure the subvol isn't mounted, btrfs will delete a mounted subvol but we probably shouldn't
-        if (Btrfs::isMounted(uuid, subvolid)) {
-            displayError(tr("You cannot delete mounted subvolume: ") + subvol + "\n\n" +
-                         tr("Please unmount the subvolume before deleting"));
-            continue;
-        }
-
-        if (!m_btrfs->deleteSubvol(uuid, subvolid)) {
-            displayError(tr("Failed to delete subvolume " + subvol.toUtf8()));
-            continue;
-        }
-
-        // If this is a Snapper snapshot and removing the metadata was agreed to, clean it up
-        if (cleanupSnapper && Btrfs::isSnapper(subvol)) {
-            const QString mountpoint = m_btrfs->mountRoot(uuid);
-            const QFileInfo subvolumeFileInfo(QDir::cleanPath(mountpoint + QDir::separator() + subvol));
-            subvolumeFileInfo.dir().removeRecursively();
-        }
-    }
-
-    // Reload data and refresh the UI
-    for (const auto &uuid : qAsConst(uuids)) {
-        m_btrfs->loadSubvols(uuid);
-    }
-    m_subvolumeModel->load(m_btrfs->filesystems());
-    refreshSubvolListUi();
+    // Delete everything in the background and reload the filesystems which had subvolumes deleted
+    setBusy(true);
+    onFinished(QtConcurrent::run([this, deletions, cleanupSnapper]() mutable {
+                   // The progress is reported from the workers so it is shown on the GUI thread
+                   const int total = deletions.count();
+                   const auto showProgress = [this, total](const SubvolumeDeletion &, int handled) {
+                       const QString message = tr("Deleted %1 of %2 subvolumes").arg(handled).arg(total);
+                       QMetaObject::invokeMethod(this, [this, message]() { statusBar()->showMessage(message); }, Qt::QueuedConnection);
+                   };
+                   m_btrfs->deleteSubvols(deletions, cleanupSnapper, false, showProgress);
+
+                   QSet<QString> uuids;
+                   for (const SubvolumeDeletion &deletion : qAsConst(deletions)) {
+                       if (deletion.isDeleted) {
+                           uuids.insert(deletion.filesystemUuid);
+                       }
+                   }
+
+                   QVector<SubvolumeDelta> deltas;
+                   for (const QString &uuid : qAsConst(uuids)) {
+                       deltas.append(m_btrfs->loadSubvols(uuid));
+                   }
+                   return qMakePair(deletions, deltas);
+               }),
+               this, [this](const QPair<QVector<SubvolumeDeletion>, QVector<SubvolumeDelta>> &result) {
+                   for (const SubvolumeDelta &delta : result.second) {
+                       m_subvolumeModel->applyDelta(delta);
+                   }
+                   refreshSubvolListUi();
+                   statusBar()->clearMessage();
+                   setBusy(false);
+
+                   // Report all the failures together rather than one dialog for each subvolume
+                   QStringList errors;
+                   for (const SubvolumeDeletion &deletion : result.first) {
+                       if (!deletion.isDeleted) {
+                           errors.append(deletion.error);
+                       }
+                   }
+                   if (!errors.isEmpty()) {
+                       displayError(tr("Failed to delete subvolume!") + "\n\n" + errors.join("\n\n"));
+                   }
+               });
 }
 
 void MainWindow::on_toolButton_subvolRefresh_clicked()
 {
-    const auto filesystems = m_btrfs->listFilesystems();
-    for (const QString &uuid : filesystems) {
-        m_btrfs->loadSubvols(uuid);
-    }
-
-    m_subvolumeModel->load(m_btrfs->filesystems());
-    refreshSubvolListUi();
+    setBusy(true);
+    onFinished(QtConcurrent::run([this]() {
+                   QVector<SubvolumeDelta> deltas;
+                   const auto filesystems = m_btrfs->listFilesystems();
+                   for (const QString &uuid : filesystems) {
+                       deltas.append(m_btrfs->loadSubvols(uuid));
+                   }
+                   return deltas;
+               }),
+               this, [this](const QVector<SubvolumeDelta> &deltas) {
+                   for (const SubvolumeDelta &delta : deltas) {
+                       m_subvolumeModel->applyDelta(delta);
+                   }
+                   refreshSubvolListUi();
+                   setBusy(false);
+               });
 
     m_ui->toolButton_subvolRefresh->clearFocus();
 }
 
 void MainWindow::on_toolButton_snapperRestore_clicked()
 {
-    if (m_ui->tableWidget_snapperRestore->currentRow() == -1) {
+    const SnapperSubvolume *snapshot = selectedSnapperSubvolume();
+    if (snapshot == nullptr) {
         displayError(tr("Nothing selected!"));
         return;
     }
 
     QString config = cleanTargetSubvol(m_ui->comboBox_snapperSubvols->currentText());
-    QString subvol =
-        m_ui->tableWidget_snapperRestore->item(m_ui->tableWidget_snapperRestore->currentRow(), (int)SnapperRestoreTableColumn::Subvolume)
-            ->text();
+    QString subvol = snapshot->subvol;
 
     QVector<SnapperSubvolume> snapperSubvols = m_snapper->subvols(config);
 
@@ -1243,15 +1357,14 @@ void MainWindow::on_toolButton_snapperRestore_clicked()
 
 void MainWindow::on_toolButton_snapperBrowse_clicked()
 {
-    const int currentRow = m_ui->tableWidget_snapperRestore->currentRow();
-    if (currentRow == -1) {
+    const SnapperSubvolume *snapshot = selectedSnapperSubvolume();
+    if (snapshot == nullptr) {
         displayError("You must select snapshot to browse!");
         return;
     }
 
-    QString subvolPath = m_ui->tableWidget_snapperRestore->item(currentRow, (int)SnapperRestoreTableColumn::Subvolume)->text();
-    uint snapshotNumber =
-        m_ui->tableWidget_snapperRestore->item(currentRow, (int)SnapperRestoreTableColumn::Number)->data(Qt::DisplayRole).toUInt();
+    QString subvolPath = snapshot->subvol;
+    uint snapshotNumber = snapshot->snapshotNum;
 
     QString target = cleanTargetSubvol(m_ui->comboBox_snapperSubvols->currentText());
     QVector<SnapperSubvolume> snapperSubvols = m_snapper->subvols(target);
@@ -1296,20 +1409,26 @@ void MainWindow::on_toolButton_snapperCreate_clicked()
         return;
     }
 
-    // OK, let's go ahead and take the snapshot
-    const SnapperResult result = m_snapper->createSnapshot(config, snapshotDescription);
-
-    if (result.exitCode != 0) {
-        displayError(result.outputList.at(0));
-    }
-
-    // Reload the data and refresh the UI
-    m_btrfs->loadVolumes();
-    m_snapper->load();
-    loadSnapperUI();
-    m_ui->comboBox_snapperConfigs->setCurrentText(config);
-    populateSnapperGrid();
-    populateSnapperRestoreGrid();
+    // OK, let's go ahead and take the snapshot and reload the data in the background
+    setBusy(true);
+    onFinished(QtConcurrent::run([this, config, snapshotDescription]() {
+                   const SnapperResult result = m_snapper->createSnapshot(config, snapshotDescription);
+                   m_btrfs->loadVolumes();
+                   m_snapper->load();
+                   return result;
+               }),
+               this, [this, config](const SnapperResult &result) {
+                   // Refresh the UI
+                   loadSnapperUI();
+                   m_ui->comboBox_snapperConfigs->setCurrentText(config);
+                   populateSnapperGrid();
+                   populateSnapperRestoreGrid();
+                   setBusy(false);
+
+                   if (result.exitCode != 0) {
+                       displayError(result.outputList.at(0));
+                   }
+               });
 
     m_ui->toolButton_snapperCreate->clearFocus();
 }
@@ -1317,9 +1436,9 @@ void MainWindow::on_toolButton_snapperCreate_clicked()
 void MainWindow::on_toolButton_snapperDelete_clicked()
 {
     // Get all the rows that were selected
-    const QList<QTableWidgetItem *> list = m_ui->tableWidget_snapperNew->selectedItems();
+    const QVector<SnapperSnapshot> snapshots = selectedSnapperSnapshots();
 
-    if (list.count() < 1) {
+    if (snapshots.isEmpty()) {
         displayError(tr("Nothing selected!"));
         return;
     }
@@ -1327,8 +1446,8 @@ void MainWindow::on_toolButton_snapperDelete_clicked()
     QSet<QString> numbers;
 
     // Get the snapshot numbers for the selected rows
-    for (const QTableWidgetItem *item : list) {
-        numbers.insert(m_ui->tableWidget_snapperNew->item(item->row(), 0)->text());
+    for (const SnapperSnapshot &snapshot : snapshots) {
+        numbers.insert(QString::number(snapshot.number));
     }
 
     // Ask for confirmation
@@ -1337,28 +1456,39 @@ void MainWindow::on_toolButton_snapperDelete_clicked()
 
     QString config = m_ui->comboBox_snapperConfigs->currentText();
 
-    // Delete each selected snapshot
-    for (const QString &number : qAsConst(numbers)) {
-        // This shouldn't be possible but we check anyway
-        if (config.isEmpty() || number.isEmpty()) {
-            displayError(tr("Cannot delete snapshot"));
-            return;
-        }
-
-        // Delete the snapshot
-        SnapperResult result = m_snapper->deleteSnapshot(config, number.toInt());
-        if (result.exitCode != 0) {
-            displayError(result.outputList.at(0));
-        }
+    // This shouldn't be possible but we check anyway
+    if (config.isEmpty() || numbers.contains(QString())) {
+        displayError(tr("Cannot delete snapshot"));
+        return;
     }
 
-    // Reload the data and refresh the UI
-    m_btrfs->loadVolumes();
-    m_snapper->load();
-    loadSnapperUI();
-    m_ui->comboBox_snapperConfigs->setCurrentText(config);
-    populateSnapperGrid();
-    populateSnapperRestoreGrid();
+    // Delete each selected snapshot and reload the data in the background
+    setBusy(true);
+    onFinished(QtConcurrent::run([this, config, numbers]() {
+                   QStringList errors;
+                   for (const QString &number : numbers) {
+                       SnapperResult result = m_snapper->deleteSnapshot(config, number.toInt());
+                       if (result.exitCode != 0) {
+                           errors.append(result.outputList.at(0));
+                       }
+                   }
+
+                   m_btrfs->loadVolumes();
+                   m_snapper->load();
+                   return errors;
+               }),
+               this, [this, config](const QStringList &errors) {
+                   // Refresh the UI
+                   loadSnapperUI();
+                   m_ui->comboBox_snapperConfigs->setCurrentText(config);
+                   populateSnapperGrid();
+                   populateSnapperRestoreGrid();
+                   setBusy(false);
+
+                   for (const QString &error : errors) {
+                       displayError(error);
+                   }
+               });
 
     m_ui->toolButton_snapperDelete->clearFocus();
 }
@@ -1366,9 +1496,9 @@ void MainWindow::on_toolButton_snapperDelete_clicked()
 void MainWindow::on_toolButton_snapperChangeDescription_clicked()
 {
     // Get all the rows that were selected
-    const QList<QTableWidgetItem *> list = m_ui->tableWidget_snapperNew->selectedItems();
+    const QVector<SnapperSnapshot> snapshots = selectedSnapperSnapshots();
 
-    if (list.count() < 1) {
+    if (snapshots.isEmpty()) {
         displayError(tr("Nothing selected!"));
         return;
     }
@@ -1376,8 +1506,8 @@ void MainWindow::on_toolButton_snapperChangeDescription_clicked()
     QSet<QString> numbers;
 
     // Get the snapshot numbers for the selected rows
-    for (const QTableWidgetItem *item : list) {
-        numbers.insert(m_ui->tableWidget_snapperNew->item(item->row(), 0)->text());
+    for (const SnapperSnapshot &snapshot : snapshots) {
+        numbers.insert(QString::number(snapshot.number));
     }
 
     const int snapshotsCount = numbers.count();
@@ -1387,7 +1517,7 @@ void MainWindow::on_toolButton_snapperChangeDescription_clicked()
 
     // only applicable if there is a single snapshot selected
     if (snapshotsCount == 1) {
-        currentDescription = m_ui->tableWidget_snapperNew->item(list.at(0)->row(), 4)->text();
+        currentDescription = snapshots.at(0).desc;
     }
 
     // Ask the user for the description (<u><b> is used to make the snapshot number bold and underlined)
@@ -1401,26 +1531,37 @@ void MainWindow::on_toolButton_snapperChangeDescription_clicked()
         return;
     }
 
-    // Change the description of each selected snapshot
-    for (const QString &number : qAsConst(numbers)) {
-        // This shouldn't be possible but we check anyway
-        if (config.isEmpty() || number.isEmpty()) {
-            displayError(tr("Cannot change description of snapshot"));
-            return;
-        }
-
-        // Change the description
-        SnapperResult result = m_snapper->changeSnapshotDescription(config, number.toInt(), snapshotDescription);
-        if (result.exitCode != 0) {
-            displayError(result.outputList.at(0));
-        }
+    // This shouldn't be possible but we check anyway
+    if (config.isEmpty() || numbers.contains(QString())) {
+        displayError(tr("Cannot change description of snapshot"));
+        return;
     }
 
-    // Reload the data and refresh the UI
-    m_snapper->load();
-    loadSnapperUI();
-    m_ui->comboBox_snapperConfigs->setCurrentText(config);
-    populateSnapperGrid();
+    // Change the description of each selected snapshot and reload the data in the background
+    setBusy(true);
+    onFinished(QtConcurrent::run([this, config, numbers, snapshotDescription]() {
+                   QStringList errors;
+                   for (const QString &number : numbers) {
+                       SnapperResult result = m_snapper->changeSnapshotDescription(config, number.toInt(), snapshotDescription);
+                       if (result.exitCode != 0) {
+                           errors.append(result.outputList.at(0));
+                       }
+                   }
+
+                   m_snapper->load();
+                   return errors;
+               }),
+               this, [this, config](const QStringList &errors) {
+                   // Refresh the UI
+                   loadSnapperUI();
+                   m_ui->comboBox_snapperConfigs->setCurrentText(config);
+                   populateSnapperGrid();
+                   setBusy(false);
+
+                   for (const QString &error : errors) {
+                       displayError(error);
+                   }
+               });
 }
 
 void MainWindow::subvolsSelectionChanged()
@@ -1435,32 +1576,44 @@ void MainWindow::subvolsSelectionChanged()
         } else {
             m_ui->toolButton_subvolumeBrowse->setEnabled(true);
 
-            QString subvolPath = m_subvolumeModel->subvolume(m_subvolumeFilterModel->mapToSource(selectedIndexes.at(0)).row()).subvolName;
+            const int row = m_subvolumeFilterModel->mapToSource(selectedIndexes.at(0)).row();
 
             // Ensure it is a backup we created
-            m_ui->toolButton_subvolRestoreBackup->setEnabled(m_btrfs->isSubvolumeBackup(subvolPath));
+            m_ui->toolButton_subvolRestoreBackup->setEnabled(m_subvolumeModel->kinds(row).testFlag(SubvolumeModel::IsBackup));
         }
     }
 }
 
 void MainWindow::on_tabWidget_mainWindow_currentChanged()
 {
-    if (m_ui->tabWidget_mainWindow->currentWidget() == m_ui->tab_btrfsmaintenance) {
+    QWidget *tab = m_ui->tabWidget_mainWindow->currentWidget();
+    if (!m_populatedTabs.contains(tab)) {
+        populateTab(tab);
+    } else if (tab == m_ui->tab_btrfsmaintenance) {
         refreshBmUi();
     }
 }
 
 void MainWindow::on_toolButton_snapperNewRefresh_clicked()
 {
-    m_snapper->load();
-    populateSnapperGrid();
+    setBusy(true);
+    onFinished(QtConcurrent::run([this]() { m_snapper->load(); }), this, [this]() {
+        populateSnapperGrid();
+        setBusy(false);
+    });
 }
 
 void MainWindow::on_toolButton_snapperRestoreRefresh_clicked()
 {
-    m_btrfs->loadVolumes();
-    m_snapper->loadSubvols();
-    populateSnapperRestoreGrid();
+    setBusy(true);
+    onFinished(QtConcurrent::run([this]() {
+                   m_btrfs->loadVolumes();
+                   m_snapper->loadSubvols();
+               }),
+               this, [this]() {
+                   populateSnapperRestoreGrid();
+                   setBusy(false);
+               });
 }
 
 void MainWindow::on_toolButton_subvolRestoreBackup_clicked()
@@ -1527,9 +1680,9 @@ void MainWindow::on_toolButton_subvolRestoreBackup_clicked()
 
 void MainWindow::setCleanup(const QString &cleanupArg)
 {
-    const QList<QTableWidgetItem *> list = m_ui->tableWidget_snapperNew->selectedItems();
+    const QVector<SnapperSnapshot> snapshots = selectedSnapperSnapshots();
 
-    if (list.count() < 1) {
+    if (snapshots.isEmpty()) {
         displayError(tr("Nothing selected!"));
         return;
     }
@@ -1537,34 +1690,68 @@ void MainWindow::setCleanup(const QString &cleanupArg)
     QSet<uint> numbers;
 
     // Get the snapshot numbers for the selected rows
-    for (const QTableWidgetItem *item : list) {
-        numbers.insert(m_ui->tableWidget_snapperNew->item(item->row(), 0)->text().toUInt());
+    for (const SnapperSnapshot &snapshot : snapshots) {
+        numbers.insert(snapshot.number);
     }
 
     const QString config = m_ui->comboBox_snapperConfigs->currentText();
 
-    for (const uint &number : qAsConst(numbers)) {
-        SnapperResult sr = m_snapper->setCleanupAlgorithm(config, number, cleanupArg);
-        if (sr.exitCode != 0) {
-            displayError(tr("Failed to set cleanup algorithm for snapshot %1").arg(number));
+    // Set the cleanup algorithm and reload the data in the background
+    setBusy(true);
+    onFinished(QtConcurrent::run([this, config, numbers, cleanupArg]() {
+                   QList<uint> failed;
+                   for (const uint &number : numbers) {
+                       SnapperResult sr = m_snapper->setCleanupAlgorithm(config, number, cleanupArg);
+                       if (sr.exitCode != 0) {
+                           failed.append(number);
+                       }
+                   }
+
+                   m_snapper->load();
+                   return failed;
+               }),
+               this, [this, config](const QList<uint> &failed) {
+                   // Refresh the UI
+                   loadSnapperUI();
+                   m_ui->comboBox_snapperConfigs->setCurrentText(config);
+                   populateSnapperGrid();
+                   setBusy(false);
+
+                   for (const uint number : failed) {
+                       displayError(tr("Failed to set cleanup algorithm for snapshot %1").arg(number));
+                   }
+               });
+}
+
+void MainWindow::reportStartupPhase(const QString &phase, qint64 elapsed) const
+{
+    qDebug().noquote() << QString("Startup: %1 took %2 ms, finished %3 ms after the window was created")
+                              .arg(phase)
+                              .arg(elapsed)
+                              .arg(m_startupTimer.elapsed());
+}
+
+void MainWindow::setBusy(bool busy)
+{
+    if (busy) {
+        if (m_busyCount++ == 0) {
+            m_ui->tabWidget_mainWindow->setEnabled(false);
+            QApplication::setOverrideCursor(Qt::BusyCursor);
         }
+    } else if (m_busyCount > 0 && --m_busyCount == 0) {
+        m_ui->tabWidget_mainWindow->setEnabled(true);
+        QApplication::restoreOverrideCursor();
     }
-
-    // Reload the data and refresh the UI
-    m_snapper->load();
-    loadSnapperUI();
-    m_ui->comboBox_snapperConfigs->setCurrentText(config);
-    populateSnapperGrid();
 }
 
 void MainWindow::setEnableQuotaButtonStatus()
 {
-    if (m_ui->comboBox_btrfsDevice->currentText().isEmpty()) {
+    const QString uuid = m_ui->comboBox_btrfsDevice->currentText();
+    if (uuid.isEmpty()) {
         return;
     }
-    const QString mountpoint = Btrfs::findAnyMountpoint(m_ui->comboBox_btrfsDevice->currentText());
 
-    if (!mountpoint.isEmpty() && m_btrfs->isQuotaEnabled(mountpoint)) {
+    if (m_btrfs->filesystem(uuid).isQuotaEnabled) {
         m_ui->pushButton_enableQuota->setText(tr("Disable Btrfs Quotas"));
     } else {
         m_ui->pushButton_enableQuota->setText(tr("Enable Btrfs Quotas"));
@@ -1,14 +1,24 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include <QElapsedTimer>
+#include <QFuture>
 #include <QMainWindow>
 #include <QSet>
 
 class QCheckBox;
+class QSortFilterProxyModel;
 
 class Btrfs;
 class BtrfsMaintenance;
+class BtrfsMonitor;
+struct BalanceProgress;
+struct ScrubProgress;
 class Snapper;
+struct SnapperSnapshot;
+class SnapperSnapshotModel;
+struct SnapperSubvolume;
+class SnapperSubvolumeModel;
 class SubvolumeFilterModel;
 class SubvolumeModel;
 
@@ -55,16 +65,44 @@ class MainWindow : public QMainWindow {
     bool m_hasBtrfsmaintenance = false;
     SubvolumeFilterModel *m_subvolumeFilterModel = nullptr;
     SubvolumeModel *m_subvolumeModel = nullptr;
+    SnapperSnapshotModel *m_snapperSnapshotModel = nullptr;
+    QSortFilterProxyModel *m_snapperSnapshotSortModel = nullptr;
+    SnapperSubvolumeModel *m_snapperSubvolumeModel = nullptr;
+    QSortFilterProxyModel *m_snapperSubvolumeSortModel = nullptr;
+    // The number of background operations currently holding the UI busy
+    int m_busyCount = 0;
+
+    // The btrfs and snapper data is loaded on a worker thread the first time a tab which needs it is shown
+    QFuture<void> m_btrfsLoad;
+    QFuture<void> m_snapperLoad;
+    bool m_isBtrfsLoadStarted = false;
+    bool m_isSnapperLoadStarted = false;
+    // The tabs which have been populated, each tab is populated the first time it is shown
+    QSet<QWidget *> m_populatedTabs;
+    // Started when the window is created so the startup report can show when each phase finished
+    QElapsedTimer m_startupTimer;
+
+    /**
+     * @brief Polls the balance and scrub progress of the filesystem selected on the BTRFS tab
+     */
+    BtrfsMonitor *m_btrfsMonitor = nullptr;
+
+    /**
+     * @brief Set once the summary of the last scrub has been shown for the selected filesystem
+     */
+    bool m_hasScrubSummary = false;
 
     /**
-     * @brief Timer used to periodically update UI on balance progress
+     * @brief Loads the btrfs data on a worker thread the first time it is called
+     * @return A QFuture which finishes once the btrfs data has been loaded
      */
-    QTimer *m_balanceTimer;
+    QFuture<void> loadBtrfsData();
 
     /**
-     * @brief Timer used to periodically update UI on scrub progress
+     * @brief Loads the snapper data on a worker thread the first time it is called, after the btrfs data is loaded
+     * @return A QFuture which finishes once the snapper data has been loaded
      */
-    QTimer *m_scrubTimer;
+    QFuture<void> loadSnapperData();
 
     /**
      * @brief Checks if snapper is installed and load snapper UI elements.
@@ -97,6 +135,29 @@ class MainWindow : public QMainWindow {
      */
     void populateSnapperConfigSettings();
 
+    /**
+     * @brief Populates @p tab the first time it is shown, loading the data it needs in the background
+     * @param tab - The page of tabWidget_mainWindow to populate
+     */
+    void populateTab(QWidget *tab);
+
+    /**
+     * @brief Logs how long a phase of the startup took
+     *
+     * Safe to call from a worker thread.
+     * @param phase - A description of the phase
+     * @param elapsed - The time the phase took in msecs
+     */
+    void reportStartupPhase(const QString &phase, qint64 elapsed) const;
+
+    /**
+     * @brief Locks or unlocks the UI while data is loaded on a worker thread
+     *
+     * Calls may be nested, the UI is only unlocked once every setBusy(true) has been matched by a setBusy(false).
+     * @param busy - True to lock the UI and show a busy cursor, false to undo a previous lock
+     */
+    void setBusy(bool busy);
+
     /**
      * @brief setCleanup
      * @param cleanupArg
@@ -130,6 +191,18 @@ class MainWindow : public QMainWindow {
      */
     void restoreSnapshot(const QString &uuid, const QString &subvolume);
 
+    /**
+     * @brief Gets the snapshots selected in the grid on the Snapper New subtab
+     * @return The selected snapshots, each one appears once
+     */
+    QVector<SnapperSnapshot> selectedSnapperSnapshots() const;
+
+    /**
+     * @brief Gets the current snapshot in the grid on the Snapper Restore subtab
+     * @return A pointer to the snapshot or nullptr if nothing is selected
+     */
+    const SnapperSubvolume *selectedSnapperSubvolume() const;
+
     /**
      * @brief Initial application setup.
      * @return
@@ -159,14 +232,16 @@ class MainWindow : public QMainWindow {
     void bmRefreshMountpoints();
 
     /**
-     * @brief Method used to fetch and update the btrfs balance status
+     * @brief Updates the balance status and button from the progress reported by m_btrfsMonitor
+     * @param progress - The latest balance progress
      */
-    void btrfsBalanceStatusUpdateUI();
+    void btrfsBalanceStatusUpdateUI(const BalanceProgress &progress);
 
     /**
-     * @brief Method used to fetch and update the btrfs balance status
+     * @brief Updates the scrub status and button from the progress reported by m_btrfsMonitor
+     * @param progress - The latest scrub progress
      */
-    void btrfsScrubStatusUpdateUI();
+    void btrfsScrubStatusUpdateUI(const ScrubProgress &progress);
 
     /**
      * @brief Method used to fetch and update the btrfs balance status
@@ -276,7 +351,7 @@ class MainWindow : public QMainWindow {
     /**
      * @brief Snapper table right click handler.
      */
-    void on_tableWidget_snapperNew_customContextMenuRequested(const QPoint &pos);
+    void on_tableView_snapperNew_customContextMenuRequested(const QPoint &pos);
 
     /**
      * @brief Mainwindow tab selection change event handler.
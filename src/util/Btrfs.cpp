@@ -1,28 +1,60 @@
 #include "util/Btrfs.h"
+#include "util/MetadataCache.h"
+#include "util/MountTable.h"
 #include "util/Settings.h"
 #include "util/System.h"
+#include "util/Trace.h"
+#include <sys/ioctl.h>
 #include <sys/mount.h>
 
 #include <QDebug>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMultiHash>
 #include <QRegularExpression>
+#include <QSet>
 #include <QTemporaryDir>
+#include <QThread>
+#include <QThreadPool>
 #include <btrfsutil.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#include <endian.h>
+#include <fcntl.h>
+#include <linux/btrfs.h>
+#include <linux/btrfs_tree.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <vector>
 
 namespace {
 
-QString uuidToString(const uint8_t uuid[16])
+// The number of extents mapped by each FIEMAP call
+constexpr uint32_t FIEMAP_BATCH_SIZE = 64;
+
+// Inline extents hold at most a page of data, anything bigger can't be inline
+constexpr off_t MAX_INLINE_SIZE = 4096;
+
+// How often the deleted subvolumes are checked while waiting for the cleaner
+constexpr unsigned long CLEANER_POLL_MS = 500;
+
+// The most directories walked looking for subvolumes below changed directories before all the children of a tree are read
+constexpr int MAX_CHANGED_DIRS = 4096;
+
+QUuid uuidFromBytes(const uint8_t uuid[16])
 {
-    QString ret;
-    bool allZeros = true;
-    for (int i = 0; i < 16; ++i) {
-        ret.append(QString::number(uuid[i], 16));
-        if ((i + 1) % 2 == 0 && (i > 1 && i < 10)) {
-            ret.append('-');
-        }
-        allZeros &= (uuid[i] == 0);
-    }
-    return allZeros ? "" : ret;
+    // An all zero UUID becomes a null QUuid
+    return QUuid::fromRfc4122(QByteArray::fromRawData(reinterpret_cast<const char *>(uuid), 16));
 }
 
 Subvolume infoToSubvolume(const QString &fileSystemUuid, const QString &name, const struct btrfs_util_subvolume_info &subvolInfo)
@@ -31,9 +63,9 @@ Subvolume infoToSubvolume(const QString &fileSystemUuid, const QString &name, co
     ret.subvolName = name;
     ret.parentId = subvolInfo.parent_id;
     ret.id = subvolInfo.id;
-    ret.uuid = uuidToString(subvolInfo.uuid);
-    ret.parentUuid = uuidToString(subvolInfo.parent_uuid);
-    ret.receivedUuid = uuidToString(subvolInfo.received_uuid);
+    ret.uuid = uuidFromBytes(subvolInfo.uuid);
+    ret.parentUuid = uuidFromBytes(subvolInfo.parent_uuid);
+    ret.receivedUuid = uuidFromBytes(subvolInfo.received_uuid);
     ret.generation = subvolInfo.generation;
     ret.flags = subvolInfo.flags;
     ret.createdAt = QDateTime::fromSecsSinceEpoch(subvolInfo.otime.tv_sec);
@@ -41,15 +73,835 @@ Subvolume infoToSubvolume(const QString &fileSystemUuid, const QString &name, co
     return ret;
 }
 
+/**
+ * @brief Returns true if every field of @p a and @p b is the same
+ */
+bool isSameSubvolume(const Subvolume &a, const Subvolume &b)
+{
+    return a.id == b.id && a.parentId == b.parentId && a.subvolName == b.subvolName && a.uuid == b.uuid && a.parentUuid == b.parentUuid &&
+           a.receivedUuid == b.receivedUuid && a.generation == b.generation && a.filesystemUuid == b.filesystemUuid && a.size == b.size &&
+           a.exclusive == b.exclusive && a.flags == b.flags && a.createdAt == b.createdAt;
+}
+
+/**
+ * @brief Compares two versions of the subvolumes of a filesystem
+ * @param uuid - The UUID of the filesystem
+ * @param before - The subvolumes before a reload
+ * @param after - The subvolumes after a reload
+ * @return A SubvolumeDelta holding the subvolumes that only exist in @p after, differ or only exist in @p before
+ */
+SubvolumeDelta diffSubvols(const QString &uuid, const SubvolumeMap &before, const SubvolumeMap &after)
+{
+    SubvolumeDelta delta;
+    delta.filesystemUuid = uuid;
+
+    for (const Subvolume &subvol : after) {
+        const auto it = before.constFind(subvol.id);
+        if (it == before.cend()) {
+            delta.added.append(subvol);
+        } else if (!isSameSubvolume(*it, subvol)) {
+            delta.updated.append(subvol);
+        }
+    }
+
+    for (const Subvolume &subvol : before) {
+        if (!after.contains(subvol.id)) {
+            delta.removed.append(subvol.id);
+        }
+    }
+
+    return delta;
+}
+
+/**
+ * @brief Walks the items of a btrfs tree using BTRFS_IOC_TREE_SEARCH_V2
+ *
+ * The kernel compares keys as (objectid, type, offset) tuples, so when the objectid range of @p key spans more than one id
+ * @p callback will also see items with types outside of [min_type, max_type] and has to filter them itself.
+ * @param fd - An open file descriptor for any path inside the filesystem
+ * @param key - The tree and the key and transid ranges to search, nr_items is ignored
+ * @param callback - A callable taking the btrfs_ioctl_search_header and a pointer to the unaligned item data
+ * @return True if the whole range was searched, false if the ioctl failed
+ */
+template <typename Callback> bool searchTree(const int fd, btrfs_ioctl_search_key key, Callback callback)
+{
+    // A vector of __u64 keeps the search args at the front of the buffer correctly aligned
+    constexpr size_t bufferSize = 64 * 1024;
+    std::vector<uint64_t> buffer((sizeof(btrfs_ioctl_search_args_v2) + bufferSize) / sizeof(uint64_t));
+    auto *args = reinterpret_cast<btrfs_ioctl_search_args_v2 *>(buffer.data());
+    const char *data = reinterpret_cast<const char *>(args->buf);
+
+    while (true) {
+        key.nr_items = std::numeric_limits<uint32_t>::max();
+        args->key = key;
+        args->buf_size = bufferSize;
+        if (ioctl(fd, BTRFS_IOC_TREE_SEARCH_V2, args) != 0) {
+            return false;
+        }
+        if (args->key.nr_items == 0) {
+            return true;
+        }
+
+        // The items are packed back to back so the headers have to be copied out before they can be read
+        btrfs_ioctl_search_header header = {};
+        size_t pos = 0;
+        for (uint32_t i = 0; i < args->key.nr_items; ++i) {
+            memcpy(&header, data + pos, sizeof(header));
+            pos += sizeof(header);
+            callback(header, data + pos);
+            pos += header.len;
+        }
+
+        // Resume from the key directly after the last item that was returned
+        key.min_objectid = header.objectid;
+        key.min_type = header.type;
+        key.min_offset = header.offset;
+        if (key.min_offset < std::numeric_limits<uint64_t>::max()) {
+            key.min_offset++;
+        } else if (key.min_type < std::numeric_limits<uint8_t>::max()) {
+            key.min_type++;
+            key.min_offset = 0;
+        } else if (key.min_objectid < key.max_objectid) {
+            key.min_objectid++;
+            key.min_type = 0;
+            key.min_offset = 0;
+        } else {
+            return true;
+        }
+    }
+}
+
+/**
+ * @brief Returns how many bytes of raw device space are used to store a single byte with the profile in @p flags
+ * @param flags - The block group flags from a space info entry
+ * @param numDevices - The number of devices in the filesystem, used for the parity profiles
+ * @return The replication ratio of the profile
+ */
+double profileRatio(const uint64_t flags, const uint64_t numDevices)
+{
+    if (flags & (BTRFS_BLOCK_GROUP_RAID1 | BTRFS_BLOCK_GROUP_DUP | BTRFS_BLOCK_GROUP_RAID10)) {
+        return 2;
+    } else if (flags & BTRFS_BLOCK_GROUP_RAID1C3) {
+        return 3;
+    } else if (flags & BTRFS_BLOCK_GROUP_RAID1C4) {
+        return 4;
+    } else if (flags & BTRFS_BLOCK_GROUP_RAID5 && numDevices > 1) {
+        return static_cast<double>(numDevices) / static_cast<double>(numDevices - 1);
+    } else if (flags & BTRFS_BLOCK_GROUP_RAID6 && numDevices > 2) {
+        return static_cast<double>(numDevices) / static_cast<double>(numDevices - 2);
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Reads the current generation of a filesystem
+ * @param fd - An open file descriptor for any path inside the filesystem
+ * @return The generation or 0 if the kernel doesn't report it
+ */
+uint64_t readGeneration(const int fd)
+{
+    struct btrfs_ioctl_fs_info_args fsInfo = {};
+    fsInfo.flags = BTRFS_FS_INFO_FLAG_GENERATION;
+
+    // Kernels older than 5.15 don't know the flag and clear it
+    if (ioctl(fd, BTRFS_IOC_FS_INFO, &fsInfo) != 0 || !(fsInfo.flags & BTRFS_FS_INFO_FLAG_GENERATION)) {
+        return 0;
+    }
+
+    return fsInfo.generation;
+}
+
+/**
+ * @brief Populates the usage fields of @p filesystem directly from the kernel using the btrfs info ioctls
+ * @param fd - An open file descriptor for any path inside the filesystem
+ * @param filesystem - The BtrfsFilesystem to populate
+ * @return True on success, false if any of the ioctls failed
+ */
+bool readUsageIoctl(const int fd, BtrfsFilesystem &filesystem)
+{
+    struct btrfs_ioctl_fs_info_args fsInfo = {};
+    if (ioctl(fd, BTRFS_IOC_FS_INFO, &fsInfo) != 0) {
+        return false;
+    }
+    filesystem.generation = readGeneration(fd);
+
+    // Device ids are not necessarily contiguous so we probe every id up to max_id until all the devices are found
+    uint64_t totalSize = 0;
+    uint64_t allocatedSize = 0;
+    uint64_t devicesFound = 0;
+    for (uint64_t devid = 1; devid <= fsInfo.max_id && devicesFound < fsInfo.num_devices; ++devid) {
+        struct btrfs_ioctl_dev_info_args devInfo = {};
+        devInfo.devid = devid;
+        if (ioctl(fd, BTRFS_IOC_DEV_INFO, &devInfo) != 0) {
+            if (errno == ENODEV) {
+                continue;
+            }
+            return false;
+        }
+        totalSize += devInfo.total_bytes;
+        allocatedSize += devInfo.bytes_used;
+        devicesFound++;
+    }
+
+    // The first call only tells us how many slots are needed for the second one
+    struct btrfs_ioctl_space_args spaceCount = {};
+    if (ioctl(fd, BTRFS_IOC_SPACE_INFO, &spaceCount) != 0) {
+        return false;
+    }
+
+    // Every member of both structs is a __u64 so a vector of them keeps the buffer correctly aligned
+    const size_t slots = spaceCount.total_spaces;
+    std::vector<uint64_t> buffer((sizeof(btrfs_ioctl_space_args) + slots * sizeof(btrfs_ioctl_space_info)) / sizeof(uint64_t));
+    auto *spaceArgs = reinterpret_cast<btrfs_ioctl_space_args *>(buffer.data());
+    spaceArgs->space_slots = slots;
+    if (ioctl(fd, BTRFS_IOC_SPACE_INFO, spaceArgs) != 0) {
+        return false;
+    }
+
+    double rawUsed = 0;
+    double rawData = 0;
+    for (uint64_t i = 0; i < spaceArgs->total_spaces && i < slots; ++i) {
+        const btrfs_ioctl_space_info &space = spaceArgs->spaces[i];
+
+        // The global reserve is carved out of metadata and isn't allocated space of its own
+        if (space.flags & BTRFS_SPACE_INFO_GLOBAL_RSV) {
+            continue;
+        }
+
+        const double ratio = profileRatio(space.flags, fsInfo.num_devices);
+        rawUsed += static_cast<double>(space.used_bytes) * ratio;
+
+        if (space.flags & BTRFS_BLOCK_GROUP_DATA) {
+            filesystem.dataSize += space.total_bytes;
+            filesystem.dataUsed += space.used_bytes;
+            rawData += static_cast<double>(space.total_bytes) * ratio;
+        } else if (space.flags & BTRFS_BLOCK_GROUP_METADATA) {
+            filesystem.metaSize += space.total_bytes;
+            filesystem.metaUsed += space.used_bytes;
+        } else if (space.flags & BTRFS_BLOCK_GROUP_SYSTEM) {
+            filesystem.sysSize += space.total_bytes;
+            filesystem.sysUsed += space.used_bytes;
+        }
+    }
+
+    filesystem.totalSize = totalSize;
+    filesystem.allocatedSize = allocatedSize;
+    filesystem.usedSize = static_cast<uint64_t>(rawUsed);
+
+    // This matches the "Free (estimated)" calculation from btrfs fi usage, unallocated space is assumed to become data chunks
+    const double dataRatio = filesystem.dataSize > 0 ? rawData / static_cast<double>(filesystem.dataSize) : 1;
+    const uint64_t unallocated = totalSize > allocatedSize ? totalSize - allocatedSize : 0;
+    filesystem.freeSize = (filesystem.dataSize - std::min(filesystem.dataUsed, filesystem.dataSize)) +
+                          static_cast<uint64_t>(static_cast<double>(unallocated) / dataRatio);
+
+    return true;
+}
+
+/**
+ * @brief Populates the usage fields of @p filesystem by parsing the output of btrfs fi usage
+ * @param mountpoint - An absolute path to any mountpoint of the filesystem
+ * @param filesystem - The BtrfsFilesystem to populate
+ */
+void readUsageCmd(const QString &mountpoint, BtrfsFilesystem &filesystem)
+{
+    const QStringList usageLines = System::runCmd("LANG=C ; btrfs fi usage -b \"" + mountpoint + "\"", false).output.split('\n');
+    for (const QString &line : usageLines) {
+        const QStringList &cols = line.split(':');
+        QString type = cols.at(0).trimmed();
+        if (type == "Device size") {
+            filesystem.totalSize = cols.at(1).trimmed().toULong();
+        } else if (type == "Device allocated") {
+            filesystem.allocatedSize = cols.at(1).trimmed().toULong();
+        } else if (type == "Used") {
+            filesystem.usedSize = cols.at(1).trimmed().toULong();
+        } else if (type == "Free (estimated)") {
+            filesystem.freeSize = cols.at(1).split(QRegExp("\\s+"), Qt::SkipEmptyParts).at(0).trimmed().toULong();
+        } else if (type.startsWith("Data,")) {
+            filesystem.dataSize = cols.at(2).split(',').at(0).trimmed().toULong();
+            filesystem.dataUsed = cols.at(3).split(' ').at(0).trimmed().toULong();
+        } else if (type.startsWith("Metadata,")) {
+            filesystem.metaSize = cols.at(2).split(',').at(0).trimmed().toULong();
+            filesystem.metaUsed = cols.at(3).split(' ').at(0).trimmed().toULong();
+        } else if (type.startsWith("System,")) {
+            filesystem.sysSize = cols.at(2).split(',').at(0).trimmed().toULong();
+            filesystem.sysUsed = cols.at(3).split(' ').at(0).trimmed().toULong();
+        }
+    }
+}
+
+/**
+ * @brief Reads the usage data for a filesystem, preferring the ioctls and falling back to btrfs fi usage
+ * @param mountpoint - An absolute path to any mountpoint of the filesystem
+ * @return A BtrfsFilesystem with the usage fields populated
+ */
+BtrfsFilesystem readUsage(const QString &mountpoint)
+{
+    BtrfsFilesystem filesystem;
+
+    const int fd = open(mountpoint.toLocal8Bit(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        const bool success = readUsageIoctl(fd, filesystem);
+        close(fd);
+        if (success) {
+            return filesystem;
+        }
+    }
+
+    // Discard anything the ioctls partially populated before parsing the command output
+    qWarning() << "Falling back to btrfs fi usage for" << mountpoint;
+    filesystem = BtrfsFilesystem();
+    readUsageCmd(mountpoint, filesystem);
+    return filesystem;
+}
+
+/**
+ * @brief Reads every subvolume of a filesystem using libbtrfsutil
+ * @param uuid - The UUID of the filesystem
+ * @param mountpoint - An absolute path to any mountpoint of the filesystem
+ * @return A SubvolumeMap containing all the subvolumes including the root. If the iteration fails, an empty map
+ */
+SubvolumeMap readSubvols(const QString &uuid, const QString &mountpoint)
+{
+    btrfs_util_subvolume_iterator *iter;
+
+    btrfs_util_error returnCode = btrfs_util_create_subvolume_iterator(mountpoint.toLocal8Bit(), BTRFS_ROOT_ID, 0, &iter);
+    if (returnCode != BTRFS_UTIL_OK) {
+        return SubvolumeMap();
+    }
+
+    SubvolumeMap subvols;
+
+    while (returnCode != BTRFS_UTIL_ERROR_STOP_ITERATION) {
+        char *path = nullptr;
+        struct btrfs_util_subvolume_info subvolInfo;
+        returnCode = btrfs_util_subvolume_iterator_next_info(iter, &path, &subvolInfo);
+        if (returnCode == BTRFS_UTIL_OK) {
+            subvols[subvolInfo.id] = infoToSubvolume(uuid, QString::fromLocal8Bit(path), subvolInfo);
+            free(path);
+        }
+    }
+    btrfs_util_destroy_subvolume_iterator(iter);
+
+    // We need to add the root at subvolid 5
+    struct btrfs_util_subvolume_info subvolInfo;
+    returnCode = btrfs_util_subvolume_info(mountpoint.toLocal8Bit(), BTRFS_ROOT_ID, &subvolInfo);
+    if (returnCode == BTRFS_UTIL_OK) {
+        subvols[subvolInfo.id] = infoToSubvolume(uuid, QString(), subvolInfo);
+    }
+
+    return subvols;
+}
+
+/**
+ * @brief Reads a single subvolume using libbtrfsutil
+ * @param fd - An open file descriptor for any path inside the filesystem
+ * @param uuid - The UUID of the filesystem
+ * @param id - The id of the subvolume to read
+ * @return The Subvolume or an empty one if it doesn't exist or is being deleted
+ */
+Subvolume readSubvol(const int fd, const QString &uuid, const uint64_t id)
+{
+    struct btrfs_util_subvolume_info subvolInfo;
+    if (btrfs_util_subvolume_info_fd(fd, id, &subvolInfo) != BTRFS_UTIL_OK) {
+        return Subvolume();
+    }
+
+    if (id == BTRFS_ROOT_ID) {
+        return infoToSubvolume(uuid, QString(), subvolInfo);
+    }
+
+    // Deleted subvolumes lose their path before the cleaner removes the rest of them
+    char *path = nullptr;
+    if (btrfs_util_subvolume_path_fd(fd, id, &path) != BTRFS_UTIL_OK) {
+        return Subvolume();
+    }
+    const Subvolume subvol = infoToSubvolume(uuid, QString::fromLocal8Bit(path), subvolInfo);
+    free(path);
+
+    return subvol;
+}
+
+/**
+ * @brief Finds the subvolumes below the directories in the tree of @p treeId which changed since @p generation
+ *
+ * Renaming or moving a directory writes its inode item again, so only the directories with an inode transid at or after
+ * @p generation can have moved.  The directory indexes below them are walked to find the subvolumes they hold.  The
+ * root directory of the tree is left out since it can't move within the tree.
+ * @param fd - An open file descriptor for any path inside the filesystem
+ * @param treeId - The ID of the subvolume whose tree changed
+ * @param generation - The filesystem generation when the subvolumes were last read
+ * @param subvolIds - Filled with the IDs of the subvolumes below the changed directories
+ * @return True on success, false if a tree search failed or more than MAX_CHANGED_DIRS directories had to be walked
+ */
+bool findSubvolsInChangedDirs(const int fd, const uint64_t treeId, const uint64_t generation, QSet<uint64_t> &subvolIds)
+{
+    QVector<uint64_t> pending;
+    btrfs_ioctl_search_key key = {};
+    key.tree_id = treeId;
+    key.min_objectid = BTRFS_FIRST_FREE_OBJECTID + 1;
+    key.max_objectid = BTRFS_LAST_FREE_OBJECTID;
+    key.min_type = BTRFS_INODE_ITEM_KEY;
+    key.max_type = BTRFS_INODE_ITEM_KEY;
+    key.max_offset = std::numeric_limits<uint64_t>::max();
+    key.min_transid = generation;
+    key.max_transid = std::numeric_limits<uint64_t>::max();
+    const bool isSearched = searchTree(fd, key, [&](const btrfs_ioctl_search_header &header, const char *data) {
+        if (header.type != BTRFS_INODE_ITEM_KEY || header.len < sizeof(btrfs_inode_item)) {
+            return;
+        }
+
+        // Every item in a leaf written since the generation is returned, the inode transid tells which ones changed
+        btrfs_inode_item inode;
+        memcpy(&inode, data, sizeof(inode));
+        if (le64toh(inode.transid) >= generation && S_ISDIR(le32toh(inode.mode))) {
+            pending.append(header.objectid);
+        }
+    });
+    if (!isSearched) {
+        return false;
+    }
+
+    QSet<uint64_t> walked;
+    while (!pending.isEmpty()) {
+        const uint64_t dir = pending.takeLast();
+        if (walked.contains(dir)) {
+            continue;
+        }
+        walked.insert(dir);
+        if (walked.count() > MAX_CHANGED_DIRS) {
+            return false;
+        }
+
+        key = {};
+        key.tree_id = treeId;
+        key.min_objectid = dir;
+        key.max_objectid = dir;
+        key.min_type = BTRFS_DIR_INDEX_KEY;
+        key.max_type = BTRFS_DIR_INDEX_KEY;
+        key.max_offset = std::numeric_limits<uint64_t>::max();
+        key.max_transid = std::numeric_limits<uint64_t>::max();
+        const bool isWalked = searchTree(fd, key, [&](const btrfs_ioctl_search_header &header, const char *data) {
+            if (header.len < sizeof(btrfs_dir_item)) {
+                return;
+            }
+
+            btrfs_dir_item item;
+            memcpy(&item, data, sizeof(item));
+            if (item.location.type == BTRFS_ROOT_ITEM_KEY) {
+                subvolIds.insert(le64toh(item.location.objectid));
+            } else if (item.type == BTRFS_FT_DIR) {
+                pending.append(le64toh(item.location.objectid));
+            }
+        });
+        if (!isWalked) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Applies the subvolume changes made since @p generation to @p subvols
+ *
+ * Added and changed subvolumes are found by searching only the root tree leaves written at or after @p generation.  A
+ * deletion doesn't leave an item behind to find that way, so the ROOT_REF items of every known parent are listed to find
+ * the subvolumes which are still alive.  Those are small and don't pull in the much larger root items.  The children of
+ * subvolumes whose own tree changed have their paths resolved again when they are below a directory which changed, since
+ * that directory may have moved.
+ * @param fd - An open file descriptor for any path inside the filesystem
+ * @param uuid - The UUID of the filesystem
+ * @param generation - The filesystem generation when @p subvols was read
+ * @param subvols - The subvolumes to update
+ * @return True on success, false if a tree search failed and @p subvols may be incomplete
+ */
+bool readSubvolChanges(const int fd, const QString &uuid, const uint64_t generation, SubvolumeMap &subvols)
+{
+    QSet<uint64_t> candidates;
+    QSet<uint64_t> changedTrees;
+    btrfs_ioctl_search_key key = {};
+    key.tree_id = BTRFS_ROOT_TREE_OBJECTID;
+    key.min_objectid = BTRFS_FS_TREE_OBJECTID;
+    key.max_objectid = BTRFS_LAST_FREE_OBJECTID;
+    key.min_type = BTRFS_ROOT_ITEM_KEY;
+    key.max_type = BTRFS_ROOT_BACKREF_KEY;
+    key.max_offset = std::numeric_limits<uint64_t>::max();
+    key.min_transid = generation;
+    key.max_transid = std::numeric_limits<uint64_t>::max();
+    const bool isSearched = searchTree(fd, key, [&](const btrfs_ioctl_search_header &header, const char *data) {
+        const bool isSubvolume = header.objectid == BTRFS_FS_TREE_OBJECTID || header.objectid >= BTRFS_FIRST_FREE_OBJECTID;
+        if (isSubvolume && (header.type == BTRFS_ROOT_ITEM_KEY || header.type == BTRFS_ROOT_BACKREF_KEY)) {
+            candidates.insert(header.objectid);
+        }
+
+        // The root item records the last transaction that changed the tree of the subvolume
+        constexpr size_t generationOffset = offsetof(btrfs_root_item, generation);
+        if (isSubvolume && header.type == BTRFS_ROOT_ITEM_KEY && header.len >= generationOffset + sizeof(uint64_t)) {
+            uint64_t treeGeneration = 0;
+            memcpy(&treeGeneration, data + generationOffset, sizeof(treeGeneration));
+            if (le64toh(treeGeneration) >= generation) {
+                changedTrees.insert(header.objectid);
+            }
+        }
+    });
+    if (!isSearched) {
+        return false;
+    }
+
+    // Every subvolume except the top level is referenced by a ROOT_REF item keyed on its parent
+    QSet<uint64_t> parents;
+    QMultiHash<uint64_t, uint64_t> children;
+    for (const Subvolume &subvol : qAsConst(subvols)) {
+        if (subvol.id != BTRFS_ROOT_ID) {
+            parents.insert(subvol.parentId);
+            children.insert(subvol.parentId, subvol.id);
+        }
+    }
+
+    QSet<uint64_t> live = {BTRFS_ROOT_ID};
+    for (const uint64_t parent : qAsConst(parents)) {
+        key = {};
+        key.tree_id = BTRFS_ROOT_TREE_OBJECTID;
+        key.min_objectid = parent;
+        key.max_objectid = parent;
+        key.min_type = BTRFS_ROOT_REF_KEY;
+        key.max_type = BTRFS_ROOT_REF_KEY;
+        key.max_offset = std::numeric_limits<uint64_t>::max();
+        key.max_transid = std::numeric_limits<uint64_t>::max();
+        if (!searchTree(fd, key, [&live](const btrfs_ioctl_search_header &header, const char *) { live.insert(header.offset); })) {
+            return false;
+        }
+    }
+
+    const QList<uint64_t> ids = subvols.keys();
+    for (const uint64_t id : ids) {
+        if (!live.contains(id)) {
+            subvols.remove(id);
+            candidates.remove(id);
+        }
+    }
+    for (const uint64_t id : qAsConst(live)) {
+        if (!subvols.contains(id)) {
+            candidates.insert(id);
+        }
+    }
+
+    // Renaming a subvolume changes the paths of everything below it so those are read again too
+    QVector<uint64_t> pending(candidates.cbegin(), candidates.cend());
+    while (!pending.isEmpty()) {
+        const uint64_t id = pending.takeLast();
+        Subvolume subvol = readSubvol(fd, uuid, id);
+        const auto it = subvols.find(id);
+
+        if (subvol.isEmpty()) {
+            // It was deleted after the ROOT_REF items were listed
+            if (it != subvols.end()) {
+                subvols.erase(it);
+            }
+        } else if (it == subvols.end()) {
+            subvols.insert(id, subvol);
+        } else {
+            if (it->subvolName != subvol.subvolName) {
+                for (auto child = children.constFind(id); child != children.cend() && child.key() == id; ++child) {
+                    if (!candidates.contains(child.value())) {
+                        candidates.insert(child.value());
+                        pending.append(child.value());
+                    }
+                }
+            }
+
+            // The sizes are owned by the qgroups and are refreshed separately
+            subvol.size = it->size;
+            subvol.exclusive = it->exclusive;
+            *it = subvol;
+        }
+    }
+
+    // Renaming or moving a plain directory changes the paths of the subvolumes below it without touching any of their
+    // items, only the tree of their parent changes.  So the paths of the children below the changed directories of every
+    // changed tree are resolved again, along with everything below the ones that moved.  All the children of a tree are
+    // resolved again if its changed directories couldn't be walked.
+    QVector<uint64_t> unresolved;
+    for (const uint64_t parent : qAsConst(changedTrees)) {
+        if (!children.contains(parent)) {
+            continue;
+        }
+
+        QSet<uint64_t> changedChildren;
+        const bool isWalked = findSubvolsInChangedDirs(fd, parent, generation, changedChildren);
+        for (auto child = children.constFind(parent); child != children.cend() && child.key() == parent; ++child) {
+            if (!isWalked || changedChildren.contains(child.value())) {
+                unresolved.append(child.value());
+            }
+        }
+    }
+
+    QSet<uint64_t> resolved;
+    while (!unresolved.isEmpty()) {
+        const uint64_t id = unresolved.takeLast();
+        const auto it = subvols.find(id);
+        if (candidates.contains(id) || resolved.contains(id) || it == subvols.end()) {
+            continue;
+        }
+        resolved.insert(id);
+
+        char *path = nullptr;
+        if (btrfs_util_subvolume_path_fd(fd, id, &path) != BTRFS_UTIL_OK) {
+            continue;
+        }
+        const QString subvolName = QString::fromLocal8Bit(path);
+        free(path);
+
+        if (it->subvolName != subvolName) {
+            it->subvolName = subvolName;
+            for (auto child = children.constFind(id); child != children.cend() && child.key() == id; ++child) {
+                unresolved.append(child.value());
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Reads the qgroups directly from the quota tree using BTRFS_IOC_TREE_SEARCH_V2
+ * @param fd - An open file descriptor for any path inside the filesystem
+ * @param isEnabled - Set to true if quotas are enabled on the filesystem
+ * @param qgroups - If not null, populated with every qgroup of every level.  When null only the quota status is read
+ * @return True on success, false if the search failed for any reason other than quotas being disabled
+ */
+bool readQgroupsIoctl(const int fd, bool &isEnabled, QgroupMap *qgroups)
+{
+    btrfs_ioctl_search_key key = {};
+    key.tree_id = BTRFS_QUOTA_TREE_OBJECTID;
+    key.min_type = BTRFS_QGROUP_STATUS_KEY;
+    key.max_type = qgroups ? BTRFS_QGROUP_INFO_KEY : BTRFS_QGROUP_STATUS_KEY;
+    key.max_offset = std::numeric_limits<uint64_t>::max();
+    key.max_transid = std::numeric_limits<uint64_t>::max();
+
+    isEnabled = false;
+    const bool isSearched = searchTree(fd, key, [&isEnabled, qgroups](const btrfs_ioctl_search_header &header, const char *data) {
+        if (header.type == BTRFS_QGROUP_STATUS_KEY) {
+            isEnabled = true;
+        } else if (header.type == BTRFS_QGROUP_INFO_KEY && qgroups && header.len >= sizeof(btrfs_qgroup_info_item)) {
+            btrfs_qgroup_info_item info;
+            memcpy(&info, data, sizeof(info));
+
+            Qgroup qgroup;
+            qgroup.id = header.offset;
+            qgroup.referenced = le64toh(info.rfer);
+            qgroup.exclusive = le64toh(info.excl);
+            qgroups->insert(qgroup.id, qgroup);
+        }
+    });
+
+    // The quota tree only exists while quotas are enabled
+    if (!isSearched && errno == ENOENT) {
+        return true;
+    }
+
+    return isSearched;
+}
+
+/**
+ * @brief Reads the qgroups by parsing the output of btrfs qgroup show
+ * @param mountpoint - An absolute path to any mountpoint of the filesystem
+ * @param qgroups - Populated with every qgroup of every level
+ * @return True if quotas are enabled on the filesystem, false otherwise
+ */
+bool readQgroupsCmd(const QString &mountpoint, QgroupMap &qgroups)
+{
+    QStringList args = {"qgroup", "show", "--raw", mountpoint};
+    if (Settings::instance().value("qgroup_sync", false).toBool()) {
+        args.insert(3, "--sync");
+    }
+    QStringList outputList = System::runCmd("btrfs", args, false).output.split("\n");
+
+    // Nothing is output when qgroups aren't enabled
+    if (outputList.count() <= 1) {
+        return false;
+    }
+
+    // The header takes the first two lines, make sure it is more than two lines and then consume them
+    if (outputList.count() <= 2) {
+        return true;
+    }
+    outputList.takeFirst();
+    outputList.takeFirst();
+
+    // Load the data
+    for (const QString &line : qAsConst(outputList)) {
+        const QStringList qgroupList = line.split(" ", Qt::SkipEmptyParts);
+        if (qgroupList.count() < 3 || !qgroupList.at(0).contains("/")) {
+            continue;
+        }
+
+        // The qgroup is shown as <level>/<id> and stored with the level in the top 16 bits of the id
+        const QStringList qgroupId = qgroupList.at(0).split("/");
+        Qgroup qgroup;
+        qgroup.id = (qgroupId.at(0).toULongLong() << 48) | qgroupId.at(1).toULongLong();
+        qgroup.referenced = qgroupList.at(1).toULongLong();
+        qgroup.exclusive = qgroupList.at(2).toULongLong();
+        qgroups.insert(qgroup.id, qgroup);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Reads the qgroup data and populates the sizes in @p subvols
+ * @param mountpoint - An absolute path to any mountpoint of the filesystem
+ * @param subvols - The subvolumes of the filesystem to populate the sizes of
+ * @param qgroups - Populated with every qgroup of every level
+ * @return True if quotas are enabled on the filesystem, false otherwise
+ */
+bool readQgroups(const QString &mountpoint, SubvolumeMap &subvols, QgroupMap &qgroups)
+{
+    qgroups.clear();
+    bool isEnabled = false;
+    bool isRead = false;
+
+    const int fd = open(mountpoint.toLocal8Bit(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        // Committing the transaction makes the numbers exact but stalls on a busy filesystem so it is opt-in
+        if (Settings::instance().value("qgroup_sync", false).toBool()) {
+            btrfs_util_sync_fd(fd);
+        }
+        isRead = readQgroupsIoctl(fd, isEnabled, &qgroups);
+        close(fd);
+    }
+
+    if (!isRead) {
+        qWarning() << "Falling back to btrfs qgroup show for" << mountpoint;
+        qgroups.clear();
+        isEnabled = readQgroupsCmd(mountpoint, qgroups);
+    }
+
+    if (!isEnabled) {
+        // If qgroups aren't enabled we need to abort
+        return false;
+    }
+
+    // The level 0 qgroup ids are the same as the subvolume ids
+    for (Subvolume &subvol : subvols) {
+        const Qgroup qgroup = qgroups.value(subvol.id);
+        subvol.size = qgroup.referenced;
+        subvol.exclusive = qgroup.exclusive;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Reads everything about a single filesystem without touching any shared state so it can run on a worker thread
+ * @param uuid - The UUID of the filesystem to read
+ * @return A populated BtrfsFilesystem or a default constructed one if the filesystem isn't mounted
+ */
+BtrfsFilesystem readFilesystem(const QString &uuid)
+{
+    TraceSpan span("readFilesystem", "btrfs");
+    span.setArg("uuid", uuid);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const QString mountpoint = Btrfs::findAnyMountpoint(uuid);
+    const qint64 mountpointTime = timer.restart();
+    if (mountpoint.isEmpty()) {
+        return BtrfsFilesystem();
+    }
+
+    BtrfsFilesystem filesystem = readUsage(mountpoint);
+    filesystem.isPopulated = true;
+    const qint64 usageTime = timer.restart();
+
+    // Start from the subvolumes cached by the last run and only read what changed since, the usage read the generation
+    uint64_t cachedGeneration = 0;
+    bool isCached = false;
+    if (filesystem.generation > 0 && MetadataCache::instance().subvolumes(uuid, cachedGeneration, filesystem.subvolumes) &&
+        cachedGeneration > 0 && cachedGeneration <= filesystem.generation) {
+        const int fd = open(mountpoint.toLocal8Bit(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd >= 0) {
+            isCached = readSubvolChanges(fd, uuid, cachedGeneration, filesystem.subvolumes);
+            close(fd);
+        }
+    }
+    if (!isCached) {
+        filesystem.subvolumes = readSubvols(uuid, mountpoint);
+    }
+    MetadataCache::instance().setSubvolumes(uuid, filesystem.generation, filesystem.subvolumes);
+    const qint64 subvolTime = timer.restart();
+
+    filesystem.isQuotaEnabled = readQgroups(mountpoint, filesystem.subvolumes, filesystem.qgroups);
+    const qint64 qgroupTime = timer.restart();
+
+    qDebug().noquote() << QString("Loaded %1 in %2 ms (mountpoint %3 ms, usage %4 ms, %5 subvolumes %6 ms%7, qgroups %8 ms)")
+                              .arg(uuid)
+                              .arg(mountpointTime + usageTime + subvolTime + qgroupTime)
+                              .arg(mountpointTime)
+                              .arg(usageTime)
+                              .arg(filesystem.subvolumes.count())
+                              .arg(subvolTime)
+                              .arg(isCached ? " from cache" : "")
+                              .arg(qgroupTime);
+
+    return filesystem;
+}
+
+/**
+ * @brief Waits until the cleaner has removed the deleted subvolumes, the same as btrfs subvolume sync
+ * @param fd - An open file descriptor on the filesystem
+ * @param subvolIds - The IDs of the deleted subvolumes to wait for
+ */
+void waitForDeletedSubvolumes(int fd, const QSet<uint64_t> &subvolIds)
+{
+    while (true) {
+        uint64_t *pendingIds = nullptr;
+        size_t pendingCount = 0;
+        if (btrfs_util_deleted_subvolumes_fd(fd, &pendingIds, &pendingCount) != BTRFS_UTIL_OK) {
+            qWarning() << "Failed to read the deleted subvolumes:" << strerror(errno);
+            return;
+        }
+
+        const bool isPending =
+            std::any_of(pendingIds, pendingIds + pendingCount, [&subvolIds](uint64_t id) { return subvolIds.contains(id); });
+        free(pendingIds);
+        if (!isPending) {
+            return;
+        }
+
+        QThread::msleep(CLEANER_POLL_MS);
+    }
+}
+
 } // namespace
 
-Btrfs::Btrfs(QObject *parent) : QObject{parent} { loadVolumes(); }
+Btrfs::Btrfs(QObject *parent) : QObject{parent} {}
 
 Btrfs::~Btrfs() { unmountFilesystems(); }
 
-QString Btrfs::balanceStatus(const QString &mountpoint) const
+BalanceProgress Btrfs::balanceProgress(const QString &mountpoint)
 {
-    return System::runCmd("btrfs", {"balance", "status", mountpoint}, false).output;
+    BalanceProgress progress;
+
+    const int fd = open(mountpoint.toLocal8Bit(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return progress;
+    }
+
+    // The ioctl fails with ENOTCONN when there is no balance
+    struct btrfs_ioctl_balance_args args = {};
+    if (ioctl(fd, BTRFS_IOC_BALANCE_PROGRESS, &args) == 0) {
+        progress.isRunning = true;
+        progress.isPaused = !(args.state & BTRFS_BALANCE_STATE_RUNNING);
+        progress.expected = args.stat.expected;
+        progress.considered = args.stat.considered;
+        progress.completed = args.stat.completed;
+    }
+    close(fd);
+
+    return progress;
 }
 
 BtrfsFilesystem Btrfs::filesystem(const QString &uuid) const
@@ -113,47 +965,201 @@ std::optional<Subvolume> Btrfs::createSnapshot(const QString &uuid, uint64_t sub
     return ret;
 }
 
-bool Btrfs::deleteSubvol(const QString &uuid, const uint64_t subvolid)
+void Btrfs::deleteSubvols(QVector<SubvolumeDeletion> &deletions, bool removeSnapperMetadata, bool waitForCleaner,
+                          const std::function<void(const SubvolumeDeletion &, int)> &progress)
 {
-    Subvolume subvol;
-    if (m_filesystems.contains(uuid)) {
-        subvol = m_filesystems[uuid].subvolumes.value(subvolid);
-        if (subvol.parentId != 0) {
-            QString mountpoint = mountRoot(uuid);
-
-            // Everything checks out, lets delete the subvol
-            const QString subvolPath = QDir::cleanPath(mountpoint + QDir::separator() + subvol.subvolName);
-            btrfs_util_error returnCode = btrfs_util_delete_subvolume(subvolPath.toLocal8Bit(), 0);
-            if (returnCode == BTRFS_UTIL_OK) {
-                return true;
+    TraceSpan span("Btrfs::deleteSubvols", "btrfs");
+    span.setArg("subvolumes", deletions.count());
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Everything that needs the mount table or mounting is resolved here, once per filesystem rather than per subvolume
+    MountTable::instance().invalidate();
+    QMap<QString, QString> mountpoints;
+    // The indexes into deletions of the subvolumes to delete, grouped by the depth of their path
+    QMap<int, QVector<int>> levels;
+    int handledCount = 0;
+    for (int i = 0; i < deletions.count(); i++) {
+        SubvolumeDeletion &deletion = deletions[i];
+        const Subvolume subvol = m_filesystems.value(deletion.filesystemUuid).subvolumes.value(deletion.subvolId);
+
+        if (subvol.isEmpty() || subvol.parentId == 0 || subvol.subvolName != deletion.subvolName) {
+            deletion.error = tr("Invalid subvolume ID");
+        } else if (MountTable::instance().isMounted(deletion.filesystemUuid, deletion.subvolId)) {
+            // btrfs will delete a mounted subvol but we probably shouldn't
+            deletion.error = tr("You cannot delete mounted subvolume: ") + deletion.subvolName + "\n\n" +
+                             tr("Please unmount the subvolume before deleting");
+        } else {
+            if (!mountpoints.contains(deletion.filesystemUuid)) {
+                mountpoints.insert(deletion.filesystemUuid, mountRoot(deletion.filesystemUuid));
+            }
+            if (mountpoints.value(deletion.filesystemUuid).isEmpty()) {
+                deletion.error = tr("Failed to mount the filesystem");
+            } else {
+                levels[static_cast<int>(deletion.subvolName.count('/'))].append(i);
+                continue;
             }
         }
+
+        if (progress) {
+            progress(deletion, ++handledCount);
+        }
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(std::max(Settings::instance().value("delete_threads", 4).toInt(), 1));
+
+    // The workers each write a different element so the vector must not be shared while they run
+    SubvolumeDeletion *items = deletions.data();
+    QMutex mutex;
+    QMap<QString, QSet<uint64_t>> deletedIds;
+
+    // A subvolume can't be deleted while it contains another one so each level has to finish before its parents start
+    for (auto level = levels.crbegin(); level != levels.crend(); ++level) {
+        for (const int i : *level) {
+            pool.start(QRunnable::create([&, i]() {
+                SubvolumeDeletion &deletion = items[i];
+                const QString mountpoint = mountpoints.value(deletion.filesystemUuid);
+                const QString subvolPath = QDir::cleanPath(mountpoint + QDir::separator() + deletion.subvolName);
+
+                if (btrfs_util_delete_subvolume(subvolPath.toLocal8Bit(), 0) == BTRFS_UTIL_OK) {
+                    deletion.isDeleted = true;
+
+                    // Snapper keeps the snapshot in a numbered directory together with its metadata
+                    if (removeSnapperMetadata && isSnapper(deletion.subvolName)) {
+                        QFileInfo(subvolPath).dir().removeRecursively();
+                    }
+                } else {
+                    deletion.error = tr("Failed to delete subvolume ") + deletion.subvolName + "\n\n" + strerror(errno);
+                }
+
+                QMutexLocker lock(&mutex);
+                if (deletion.isDeleted) {
+                    deletedIds[deletion.filesystemUuid].insert(deletion.subvolId);
+                }
+                if (progress) {
+                    progress(deletion, ++handledCount);
+                }
+            }));
+        }
+        pool.waitForDone();
     }
 
-    // If we get to here, it failed
-    return false;
+    // Commit the deletions of each filesystem in a single transaction
+    for (auto it = deletedIds.cbegin(); it != deletedIds.cend(); ++it) {
+        const int fd = open(mountpoints.value(it.key()).toLocal8Bit(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+
+        uint64_t transid = 0;
+        if (btrfs_util_start_sync_fd(fd, &transid) != BTRFS_UTIL_OK || btrfs_util_wait_sync_fd(fd, transid) != BTRFS_UTIL_OK) {
+            qWarning() << "Failed to commit the subvolume deletions on" << it.key() << ":" << strerror(errno);
+        } else if (waitForCleaner) {
+            waitForDeletedSubvolumes(fd, it.value());
+        }
+        close(fd);
+    }
+
+    qDebug().noquote() << QString("Deleted %1 of %2 subvolumes in %3 ms using %4 threads")
+                              .arg(std::accumulate(deletedIds.cbegin(), deletedIds.cend(), 0,
+                                                   [](int count, const QSet<uint64_t> &ids) { return count + ids.count(); }))
+                              .arg(deletions.count())
+                              .arg(timer.elapsed())
+                              .arg(pool.maxThreadCount());
 }
 
-QString Btrfs::findAnyMountpoint(const QString &uuid)
+QByteArray Btrfs::fileExtentKey(const QString &path)
 {
-    const QStringList outputList = System::runCmd("findmnt", {"-t", "btrfs", "-lno", "uuid,target"}, false).output.split("\n");
+    const int fd = open(path.toLocal8Bit(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        return QByteArray();
+    }
 
-    for (const QString &line : outputList) {
-        if (line.section(" ", 0, 0).trimmed() == uuid) {
-            return line.section(" ", 1).trimmed();
+    QByteArray key;
+    const auto appendField = [&key](uint64_t value) { key.append(reinterpret_cast<const char *>(&value), sizeof(value)); };
+
+    struct stat st = {};
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return QByteArray();
+    }
+    appendField(static_cast<uint64_t>(st.st_size));
+    appendField(static_cast<uint64_t>(st.st_mtim.tv_sec));
+    appendField(static_cast<uint64_t>(st.st_mtim.tv_nsec));
+
+    std::vector<uint64_t> buffer((sizeof(fiemap) + FIEMAP_BATCH_SIZE * sizeof(fiemap_extent)) / sizeof(uint64_t) + 1);
+    auto *map = reinterpret_cast<fiemap *>(buffer.data());
+    bool hasInlineData = false;
+    bool isLast = st.st_size == 0;
+    uint64_t start = 0;
+
+    while (!isLast) {
+        std::fill(buffer.begin(), buffer.end(), 0);
+        map->fm_start = start;
+        map->fm_length = FIEMAP_MAX_OFFSET - start;
+        map->fm_extent_count = FIEMAP_BATCH_SIZE;
+
+        if (ioctl(fd, FS_IOC_FIEMAP, map) != 0) {
+            close(fd);
+            return QByteArray();
+        }
+
+        // Only holes are left
+        if (map->fm_mapped_extents == 0) {
+            break;
+        }
+
+        for (uint32_t i = 0; i < map->fm_mapped_extents; i++) {
+            const fiemap_extent &extent = map->fm_extents[i];
+
+            // Data that hasn't been written out yet has no location to compare
+            if (extent.fe_flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC)) {
+                close(fd);
+                return QByteArray();
+            }
+
+            if (extent.fe_flags & FIEMAP_EXTENT_DATA_INLINE) {
+                hasInlineData = true;
+            } else {
+                appendField(extent.fe_logical);
+                appendField(extent.fe_physical);
+                appendField(extent.fe_length);
+            }
+
+            start = extent.fe_logical + extent.fe_length;
+            isLast = extent.fe_flags & FIEMAP_EXTENT_LAST;
         }
     }
 
-    return QString();
+    if (hasInlineData) {
+        if (st.st_size > MAX_INLINE_SIZE) {
+            close(fd);
+            return QByteArray();
+        }
+
+        QByteArray data(static_cast<int>(st.st_size), Qt::Uninitialized);
+        if (pread(fd, data.data(), static_cast<size_t>(data.size()), 0) != st.st_size) {
+            close(fd);
+            return QByteArray();
+        }
+        key.append(data);
+    }
+
+    close(fd);
+    return key;
 }
 
+QString Btrfs::findAnyMountpoint(const QString &uuid) { return MountTable::instance().findAnyMountpoint(uuid); }
+
 bool Btrfs::isSnapper(const QString &subvolume)
 {
     static QRegularExpression re("\\/[0-9]*\\/snapshot$");
     return re.match(subvolume).hasMatch();
 }
 
-bool Btrfs::isSubvolumeBackup(QString subvolPath)
+bool Btrfs::isSubvolumeBackup(const QString &subvolPath)
 {
     static QRegularExpression re("_backup_[0-9]{17}");
     const QStringList nameParts = subvolPath.split(re);
@@ -161,15 +1167,20 @@ bool Btrfs::isSubvolumeBackup(QString subvolPath)
     return nameParts.count() == 2;
 }
 
-bool Btrfs::isMounted(const QString &uuid, const uint64_t subvolid)
-{
-    const QStringList outputList =
-        System::runCmd("findmnt -nO subvolid=" + QString::number(subvolid) + " -o uuid", false).output.trimmed().split("\n");
-    return uuid == outputList.at(0).trimmed();
-}
+bool Btrfs::isMounted(const QString &uuid, const uint64_t subvolid) { return MountTable::instance().isMounted(uuid, subvolid); }
 
 bool Btrfs::isQuotaEnabled(const QString &mountpoint)
 {
+    const int fd = open(mountpoint.toLocal8Bit(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        bool isEnabled = false;
+        const bool isRead = readQgroupsIoctl(fd, isEnabled, nullptr);
+        close(fd);
+        if (isRead) {
+            return isEnabled;
+        }
+    }
+
     return !System::runCmd("btrfs", {QStringLiteral("qgroup"), QStringLiteral("show"), mountpoint}, false).output.isEmpty();
 }
 
@@ -190,11 +1201,10 @@ QStringList Btrfs::listMountpoints()
     QStringList mountpoints;
 
     // Find all btrfs mountpoints
-    const QStringList output = System::runCmd("findmnt --real -t btrfs -lno target", false).output.trimmed().split('\n');
-    for (const QString &line : output) {
-        const QString mountpoint = line.trimmed();
-        if (!mountpoint.isEmpty()) {
-            mountpoints.append(mountpoint);
+    const QStringList targets = MountTable::instance().mountpoints();
+    for (const QString &target : targets) {
+        if (!target.isEmpty()) {
+            mountpoints.append(target);
         }
     }
 
@@ -207,6 +1217,9 @@ SubvolumeMap Btrfs::listSubvolumes(const QString &uuid) const { return m_filesys
 
 void Btrfs::loadQgroups(const QString &uuid)
 {
+    TraceSpan span("Btrfs::loadQgroups", "btrfs");
+    span.setArg("uuid", uuid);
+
     if (!isUuidLoaded(uuid)) {
         return;
     }
@@ -216,125 +1229,101 @@ void Btrfs::loadQgroups(const QString &uuid)
         return;
     }
 
-    if (!isQuotaEnabled(mountpoint)) {
-        // If qgroups aren't enabled we need to abort
-        return;
-    }
+    BtrfsFilesystem &filesystem = m_filesystems[uuid];
+    filesystem.isQuotaEnabled = readQgroups(mountpoint, filesystem.subvolumes, filesystem.qgroups);
+}
 
-    QStringList outputList = System::runCmd("btrfs", {"qgroup", "show", "--raw", "--sync", mountpoint}, false).output.split("\n");
+SubvolumeDelta Btrfs::loadSubvols(const QString &uuid, bool isFullReload)
+{
+    TraceSpan span("Btrfs::loadSubvols", "btrfs");
+    span.setArg("uuid", uuid);
 
-    // The header takes the first two lines, make sure it is more than two lines and then consume them
-    if (outputList.count() <= 2) {
-        return;
+    if (!isUuidLoaded(uuid)) {
+        return SubvolumeDelta();
     }
-    outputList.takeFirst();
-    outputList.takeFirst();
 
-    // Load the data
+    QElapsedTimer timer;
+    timer.start();
 
-    for (const QString &line : qAsConst(outputList)) {
-        const QStringList qgroupList = line.split(" ", Qt::SkipEmptyParts);
-        uint64_t subvolId;
-        if (!qgroupList.at(0).contains("/")) {
-            continue;
+    const QString mountpoint = findAnyMountpoint(uuid);
+    BtrfsFilesystem &filesystem = m_filesystems[uuid];
+    const SubvolumeMap previous = filesystem.subvolumes;
+
+    // The generation is read first so anything that changes while the subvolumes are read is picked up next time
+    uint64_t generation = 0;
+    bool isIncremental = false;
+    const int fd = open(mountpoint.toLocal8Bit(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        generation = readGeneration(fd);
+        if (generation > 0 && filesystem.generation > 0 && !isFullReload) {
+            SubvolumeMap subvols = previous;
+            isIncremental = readSubvolChanges(fd, uuid, filesystem.generation, subvols);
+            if (isIncremental) {
+                filesystem.subvolumes = subvols;
+            }
         }
+        close(fd);
+    }
 
-        subvolId = qgroupList.at(0).split("/").at(1).toUInt();
-
-        if (m_filesystems[uuid].subvolumes.contains(subvolId)) {
-            m_filesystems[uuid].subvolumes[subvolId].size = qgroupList.at(1).toULong();
-            m_filesystems[uuid].subvolumes[subvolId].exclusive = qgroupList.at(2).toULong();
-        }
+    if (!isIncremental) {
+        filesystem.subvolumes = readSubvols(uuid, mountpoint);
     }
-}
+    filesystem.generation = generation;
+    MetadataCache::instance().setSubvolumes(uuid, generation, filesystem.subvolumes);
 
-void Btrfs::loadSubvols(const QString &uuid)
-{
-    if (isUuidLoaded(uuid)) {
-        m_filesystems[uuid].subvolumes.clear();
+    loadQgroups(uuid);
 
-        const QString mountpoint = findAnyMountpoint(uuid);
-        btrfs_util_subvolume_iterator *iter;
+    const SubvolumeDelta delta = diffSubvols(uuid, previous, m_filesystems[uuid].subvolumes);
+    qDebug().noquote() << QString("Reloaded subvolumes of %1 %2 in %3 ms (%4 added, %5 updated, %6 removed)")
+                              .arg(uuid)
+                              .arg(isIncremental ? "incrementally" : "fully")
+                              .arg(timer.elapsed())
+                              .arg(delta.added.count())
+                              .arg(delta.updated.count())
+                              .arg(delta.removed.count());
 
-        btrfs_util_error returnCode = btrfs_util_create_subvolume_iterator(mountpoint.toLocal8Bit(), BTRFS_ROOT_ID, 0, &iter);
-        if (returnCode != BTRFS_UTIL_OK) {
-            return;
-        }
+    return delta;
+}
 
-        SubvolumeMap subvols;
+void Btrfs::loadVolumes() { loadVolumes(listFilesystems()); }
 
-        while (returnCode != BTRFS_UTIL_ERROR_STOP_ITERATION) {
-            char *path = nullptr;
-            struct btrfs_util_subvolume_info subvolInfo;
-            returnCode = btrfs_util_subvolume_iterator_next_info(iter, &path, &subvolInfo);
-            if (returnCode == BTRFS_UTIL_OK) {
-                subvols[subvolInfo.id] = infoToSubvolume(uuid, QString::fromLocal8Bit(path), subvolInfo);
-                free(path);
-            }
-        }
-        btrfs_util_destroy_subvolume_iterator(iter);
+void Btrfs::loadVolumes(const QStringList &uuidList)
+{
+    TraceSpan span("Btrfs::loadVolumes", "btrfs");
 
-        // We need to add the root at subvolid 5
-        struct btrfs_util_subvolume_info subvolInfo;
-        returnCode = btrfs_util_subvolume_info(mountpoint.toLocal8Bit(), BTRFS_ROOT_ID, &subvolInfo);
-        if (returnCode == BTRFS_UTIL_OK) {
-            subvols[subvolInfo.id] = infoToSubvolume(uuid, QString(), subvolInfo);
-        }
+    QElapsedTimer timer;
+    timer.start();
 
-        m_filesystems[uuid].subvolumes = subvols;
-        loadQgroups(uuid);
+    // Each filesystem is independent so they are loaded concurrently and merged as they finish
+    QThreadPool pool;
+    const int loadThreads = Settings::instance().value("load_threads", 0).toInt();
+    if (loadThreads > 0) {
+        pool.setMaxThreadCount(loadThreads);
     }
-}
 
-void Btrfs::loadVolumes()
-{
-    QStringList uuidList = listFilesystems();
-
-    // Loop through btrfs devices and retrieve filesystem usage
-    for (const QString &uuid : qAsConst(uuidList)) {
-        QString mountpoint = findAnyMountpoint(uuid);
-        if (!mountpoint.isEmpty()) {
-            BtrfsFilesystem btrfs;
-            btrfs.isPopulated = true;
-            QStringList usageLines = System::runCmd("LANG=C ; btrfs fi usage -b \"" + mountpoint + "\"", false).output.split('\n');
-            for (const QString &line : qAsConst(usageLines)) {
-                const QStringList &cols = line.split(':');
-                QString type = cols.at(0).trimmed();
-                if (type == "Device size") {
-                    btrfs.totalSize = cols.at(1).trimmed().toULong();
-                } else if (type == "Device allocated") {
-                    btrfs.allocatedSize = cols.at(1).trimmed().toULong();
-                } else if (type == "Used") {
-                    btrfs.usedSize = cols.at(1).trimmed().toULong();
-                } else if (type == "Free (estimated)") {
-                    btrfs.freeSize = cols.at(1).split(QRegExp("\\s+"), Qt::SkipEmptyParts).at(0).trimmed().toULong();
-                } else if (type.startsWith("Data,")) {
-                    btrfs.dataSize = cols.at(2).split(',').at(0).trimmed().toULong();
-                    btrfs.dataUsed = cols.at(3).split(' ').at(0).trimmed().toULong();
-                } else if (type.startsWith("Metadata,")) {
-                    btrfs.metaSize = cols.at(2).split(',').at(0).trimmed().toULong();
-                    btrfs.metaUsed = cols.at(3).split(' ').at(0).trimmed().toULong();
-                } else if (type.startsWith("System,")) {
-                    btrfs.sysSize = cols.at(2).split(',').at(0).trimmed().toULong();
-                    btrfs.sysUsed = cols.at(3).split(' ').at(0).trimmed().toULong();
-                }
+    QMutex mutex;
+    for (const QString &uuid : uuidList) {
+        pool.start(QRunnable::create([this, uuid, &mutex]() {
+            const BtrfsFilesystem filesystem = readFilesystem(uuid);
+            if (filesystem.isPopulated) {
+                QMutexLocker lock(&mutex);
+                m_filesystems[uuid] = filesystem;
             }
-            m_filesystems[uuid] = btrfs;
-            loadSubvols(uuid);
-        }
+        }));
     }
+    pool.waitForDone();
+    MetadataCache::instance().save();
+
+    qDebug().noquote() << QString("Loaded %1 filesystems in %2 ms using %3 threads")
+                              .arg(uuidList.count())
+                              .arg(timer.elapsed())
+                              .arg(pool.maxThreadCount());
 }
 
 QString Btrfs::mountRoot(const QString &uuid)
 {
     // Check to see if it is already mounted
-    QStringList findmntOutput =
-        System::runCmd("findmnt", {"-nO", "subvolid=" + QString::number(BTRFS_ROOT_ID), "-o", "uuid,target"}, false).output.split('\n');
-    QString mountpoint;
-    for (const QString &line : qAsConst(findmntOutput)) {
-        if (!line.isEmpty() && line.split(' ').at(0).trimmed() == uuid)
-            mountpoint = line.section(' ', 1).trimmed();
-    }
+    QString mountpoint = MountTable::instance().findMountpoint(uuid, BTRFS_ROOT_ID);
 
     // If it isn't mounted we need to mount it
     if (mountpoint.isEmpty()) {
@@ -444,9 +1433,55 @@ RestoreResult Btrfs::restoreSubvol(const QString &uuid, const uint64_t sourceId,
     return restoreResult;
 }
 
-QString Btrfs::scrubStatus(const QString &mountpoint) const
+ScrubProgress Btrfs::scrubProgress(const QString &mountpoint)
+{
+    ScrubProgress progress;
+
+    const int fd = open(mountpoint.toLocal8Bit(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return progress;
+    }
+
+    struct btrfs_ioctl_fs_info_args fsInfo = {};
+    if (ioctl(fd, BTRFS_IOC_FS_INFO, &fsInfo) != 0) {
+        close(fd);
+        return progress;
+    }
+
+    // Scrubs run per device, ENODEV means there is no device with that id and ENOTCONN that it isn't being scrubbed
+    uint64_t devicesFound = 0;
+    for (uint64_t devid = 1; devid <= fsInfo.max_id && devicesFound < fsInfo.num_devices; ++devid) {
+        struct btrfs_ioctl_scrub_args args = {};
+        args.devid = devid;
+        if (ioctl(fd, BTRFS_IOC_SCRUB_PROGRESS, &args) != 0) {
+            if (errno != ENODEV) {
+                devicesFound++;
+            }
+            continue;
+        }
+        devicesFound++;
+
+        const btrfs_scrub_progress &scrub = args.progress;
+        progress.isRunning = true;
+        progress.bytesScrubbed += scrub.data_bytes_scrubbed + scrub.tree_bytes_scrubbed;
+        progress.errors += scrub.read_errors + scrub.csum_errors + scrub.verify_errors + scrub.super_errors;
+        progress.correctedErrors += scrub.corrected_errors;
+        progress.uncorrectableErrors += scrub.uncorrectable_errors;
+    }
+
+    // Every copy of the used space is read so the raw used space is the amount there is to scrub
+    BtrfsFilesystem usage;
+    if (progress.isRunning && readUsageIoctl(fd, usage)) {
+        progress.bytesToScrub = usage.usedSize;
+    }
+    close(fd);
+
+    return progress;
+}
+
+QFuture<Result> Btrfs::scrubStatus(const QString &mountpoint) const
 {
-    return System::runCmd("btrfs", {"scrub", "status", mountpoint}, false).output;
+    return System::runCmdAsync("btrfs", {"scrub", "status", mountpoint}, false);
 }
 
 void Btrfs::setQgroupEnabled(const QString &mountpoint, bool enable)
@@ -614,8 +1649,22 @@ void Btrfs::unmountFilesystems()
 
 bool Subvolume::isEmpty() const { return id == 0; }
 
+double BalanceProgress::percent() const
+{
+    return expected > 0 ? std::min(100.0, static_cast<double>(completed) * 100 / static_cast<double>(expected)) : 0;
+}
+
+double ScrubProgress::percent() const
+{
+    return bytesToScrub > 0 ? std::min(100.0, static_cast<double>(bytesScrubbed) * 100 / static_cast<double>(bytesToScrub)) : 0;
+}
+
+uint16_t Qgroup::level() const { return static_cast<uint16_t>(id >> 48); }
+
+bool SubvolumeDelta::isEmpty() const { return added.isEmpty() && updated.isEmpty() && removed.isEmpty(); }
+
 bool Subvolume::isReadOnly() const { return flags & 0x1u; }
 
-bool Subvolume::isSnapshot() const { return !parentUuid.isEmpty(); }
+bool Subvolume::isSnapshot() const { return !parentUuid.isNull(); }
 
-bool Subvolume::isReceived() const { return !receivedUuid.isEmpty(); }
+bool Subvolume::isReceived() const { return !receivedUuid.isNull(); }
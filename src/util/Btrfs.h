@@ -1,10 +1,16 @@
 #ifndef BTRFS_H
 #define BTRFS_H
 
+#include "util/System.h"
+
 #include <QDateTime>
+#include <QFuture>
 #include <QMap>
 #include <QObject>
+#include <QUuid>
+#include <QVector>
 
+#include <functional>
 #include <optional>
 
 constexpr uint64_t BTRFS_ROOT_ID = 5;
@@ -15,6 +21,16 @@ struct RestoreResult {
     QString backupSubvolName;
 };
 
+// A subvolume to delete with Btrfs::deleteSubvols and the outcome
+struct SubvolumeDeletion {
+    QString filesystemUuid;
+    uint64_t subvolId = 0;
+    QString subvolName;
+    bool isDeleted = false;
+    // Why the subvolume wasn't deleted
+    QString error;
+};
+
 struct SubvolResult {
     QString name;
     bool success = false;
@@ -24,10 +40,12 @@ struct Subvolume {
     uint64_t id = 0;
     uint64_t parentId = 0;
     QString subvolName;
-    QString uuid;
-    QString parentUuid;
-    QString receivedUuid;
+    // The subvolume UUIDs are kept in binary form, a null QUuid means it isn't set
+    QUuid uuid;
+    QUuid parentUuid;
+    QUuid receivedUuid;
     uint64_t generation = 0;
+    // Every subvolume of a filesystem shares the same QString data for the filesystem UUID
     QString filesystemUuid;
     uint64_t size = 0;
     uint64_t exclusive = 0;
@@ -49,8 +67,66 @@ struct Subvolume {
 
 using SubvolumeMap = QMap<uint64_t, Subvolume>;
 
+// The progress of a balance, a balance which is paused is still running
+struct BalanceProgress {
+    bool isRunning = false;
+    bool isPaused = false;
+    // The chunk counts reported by the kernel
+    uint64_t expected = 0;
+    uint64_t considered = 0;
+    uint64_t completed = 0;
+    // The rate and ETA are calculated by BtrfsMonitor from consecutive samples, -1 means the ETA isn't known yet
+    double chunksPerSecond = 0;
+    qint64 etaSeconds = -1;
+
+    /** @brief Returns the percentage of the expected chunks that have been relocated */
+    double percent() const;
+};
+
+// The progress of a scrub summed over every device of the filesystem
+struct ScrubProgress {
+    bool isRunning = false;
+    uint64_t bytesScrubbed = 0;
+    uint64_t bytesToScrub = 0;
+    uint64_t errors = 0;
+    uint64_t correctedErrors = 0;
+    uint64_t uncorrectableErrors = 0;
+    // The rate and ETA are calculated by BtrfsMonitor from consecutive samples, -1 means the ETA isn't known yet
+    double bytesPerSecond = 0;
+    qint64 etaSeconds = -1;
+
+    /** @brief Returns the percentage of the used space that has been scrubbed */
+    double percent() const;
+};
+
+struct Qgroup {
+    // The qgroup id with the level in the top 16 bits, level 0 qgroups have the id of their subvolume
+    uint64_t id = 0;
+    uint64_t referenced = 0;
+    uint64_t exclusive = 0;
+
+    /** @brief Returns the level of the qgroup */
+    uint16_t level() const;
+};
+
+using QgroupMap = QMap<uint64_t, Qgroup>;
+
+// The subvolumes of a single filesystem that changed during a call to Btrfs::loadSubvols
+struct SubvolumeDelta {
+    QString filesystemUuid;
+    QVector<Subvolume> added;
+    QVector<Subvolume> updated;
+    QVector<uint64_t> removed;
+
+    /** @brief Returns true if no subvolumes were added, updated or removed */
+    bool isEmpty() const;
+};
+
 struct BtrfsFilesystem {
     bool isPopulated = false;
+    bool isQuotaEnabled = false;
+    // The filesystem generation when the subvolumes were last read or 0 if the kernel doesn't report it
+    uint64_t generation = 0;
     uint64_t totalSize = 0;
     uint64_t allocatedSize = 0;
     uint64_t usedSize = 0;
@@ -62,10 +138,14 @@ struct BtrfsFilesystem {
     uint64_t sysSize = 0;
     uint64_t sysUsed = 0;
     SubvolumeMap subvolumes;
+    // Every qgroup of every level, empty unless quotas are enabled
+    QgroupMap qgroups;
 };
 
 /**
  * @brief The Btrfs service class handles all btrfs device functionality.
+ *
+ * Nothing is read from the filesystems until loadVolumes() is called.
  */
 class Btrfs : public QObject {
     Q_OBJECT
@@ -76,11 +156,11 @@ class Btrfs : public QObject {
     ~Btrfs();
 
     /**
-     * @brief Checks the balance status of a given subvolume.
-     * @param mountpoint - A Qstring that represents the mountpoint to check for a btrfs balance on
-     * @return Qstring that contains the output from the btrfs balance command.
+     * @brief Reads the progress of a balance directly from the kernel with BTRFS_IOC_BALANCE_PROGRESS
+     * @param mountpoint - An absolute path to any mountpoint of the filesystem
+     * @return A BalanceProgress which isn't running if there is no balance, the rate and ETA are not filled in
      */
-    QString balanceStatus(const QString &mountpoint) const;
+    static BalanceProgress balanceProgress(const QString &mountpoint);
 
     /** @brief Returns the data for the Btrfs volume identified by @p UUID
      *
@@ -119,14 +199,30 @@ class Btrfs : public QObject {
      */
     std::optional<Subvolume> createSnapshot(const QString &fileSystemUuid, uint64_t sourceSubvolId, const QString &dest, bool readOnly);
 
-    /** @brief Deletes a given subvolume
-     *
-     *  Deletes the subvol represented by @p subvolid on @p uuid.
+    /**
+     * @brief Deletes many subvolumes at once
      *
-     *  Returns true if successful and false if it fails for any reason.
+     * Every subvolume is checked against the loaded subvolumes and the mount table up front, then they are deleted by a
+     * bounded number of workers with the deepest paths first so nested subvolumes are gone before their parents.  The
+     * deletions on each filesystem are committed together once all of them are done.
+     * @param deletions - The filesystem UUID, ID and name of the subvolumes to delete, isDeleted and error are filled in
+     * @param removeSnapperMetadata - Also remove the snapper directory holding each deleted snapper snapshot
+     * @param waitForCleaner - Wait until the cleaner has removed the deleted subvolumes, like btrfs subvolume sync
+     * @param progress - Called from the workers after each subvolume is handled with the number handled so far
+     */
+    void deleteSubvols(QVector<SubvolumeDeletion> &deletions, bool removeSnapperMetadata, bool waitForCleaner,
+                       const std::function<void(const SubvolumeDeletion &, int)> &progress = nullptr);
+
+    /**
+     * @brief Builds a key which is the same for files holding the same data without reading the data
      *
+     * The key is made from the size, modification time and the physical location of every extent, so copies of a file
+     * in different snapshots that still share all their extents have the same key.  The data of inline extents is tiny
+     * and is read into the key since those extents have no location.
+     * @param path - The absolute path to a file
+     * @return The key or an empty QByteArray if @p path isn't a regular file or its extents can't be mapped
      */
-    bool deleteSubvol(const QString &uuid, const uint64_t subvolid);
+    static QByteArray fileExtentKey(const QString &path);
 
     /**
      * @brief Finds a single mountpoint for a btrfs filesystem
@@ -156,7 +252,7 @@ class Btrfs : public QObject {
      * @param subvolPath - The QString path to the subvolume
      * @return true if subvolume is a Btrfs Assistant backup subvolume based on naming.
      */
-    bool isSubvolumeBackup(QString subvolPath);
+    static bool isSubvolumeBackup(const QString &subvolPath);
 
     /** @brief Returns true if @p subvolume is a timeshift snapshot
      *
@@ -188,17 +284,22 @@ class Btrfs : public QObject {
     SubvolumeMap listSubvolumes(const QString &uuid) const;
 
     /**
-     * @brief Reads the qgroup data to populate subvol sizes
+     * @brief Reads the qgroup data to populate subvol sizes and the qgroups of the filesystem
+     *
+     * The quota tree is read without committing a transaction first unless qgroup_sync is set in the settings
      * @param uuid - The UUID to read the qgroup data from
      */
     void loadQgroups(const QString &uuid);
 
     /** @brief Reloads the btrfs subvolume list for a given volume
      *
-     *  Updates the subvol list in m_btrfsVolumes for @p uuid
+     *  Updates the subvol list in m_btrfsVolumes for @p uuid.  When the generation of the previous load is known only the
+     *  subvolumes in root tree leaves written since then are read again, otherwise every subvolume is read.  Every
+     *  subvolume is also read when @p isFullReload is true.
      *
+     *  Returns the subvolumes that were added, updated or removed by the reload
      */
-    void loadSubvols(const QString &uuid);
+    SubvolumeDelta loadSubvols(const QString &uuid, bool isFullReload = false);
 
     /** @brief Reloads the btrfs metadata
      *
@@ -207,6 +308,13 @@ class Btrfs : public QObject {
      */
     void loadVolumes();
 
+    /** @brief Reloads the btrfs metadata of some of the filesystems
+     *
+     *  Populates m_btrfsVolumes with data from the btrfs filesystems in @p uuids
+     *
+     */
+    void loadVolumes(const QStringList &uuids);
+
     /** @brief Mounts the root of a given Btrfs volume
      *
      *  Finds the mountpoint of a btrfs volume specified by @p uuid.  If it isn't mounted, it will first mount it.
@@ -232,11 +340,18 @@ class Btrfs : public QObject {
                                 const QString &customName = QString());
 
     /**
-     * @brief Checks the scrub status of a given subvolume.
+     * @brief Reads the progress of a scrub directly from the kernel with BTRFS_IOC_SCRUB_PROGRESS
+     * @param mountpoint - An absolute path to any mountpoint of the filesystem
+     * @return A ScrubProgress which isn't running if no device is being scrubbed, the rate and ETA are not filled in
+     */
+    static ScrubProgress scrubProgress(const QString &mountpoint);
+
+    /**
+     * @brief Checks the scrub status of a given subvolume without blocking the caller.
      * @param mountpoint - A Qstring that represents the mountpoint to check for a btrfs scrub on
-     * @return Qstring that contains the output from the btrfs scrub command.
+     * @return A QFuture holding the Result of the btrfs scrub status command.
      */
-    QString scrubStatus(const QString &mountpoint) const;
+    QFuture<Result> scrubStatus(const QString &mountpoint) const;
 
     /**
      * @brief Enables or disables btrfs qgroup support on @p mountpoint
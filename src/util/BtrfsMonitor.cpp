@@ -0,0 +1,130 @@
+#include "util/BtrfsMonitor.h"
+
+#include <QTimer>
+#include <QtConcurrent>
+
+#include <algorithm>
+
+namespace {
+
+// The polling interval while an operation is running
+constexpr int ACTIVE_INTERVAL = 1000;
+
+// The longest polling interval while nothing is running
+constexpr int IDLE_INTERVAL = 30000;
+
+// How much weight a new sample gets in the smoothed rates
+constexpr double RATE_SMOOTHING = 0.3;
+
+/**
+ * @brief Blends a new rate into the previous one so the ETA doesn't jump around between samples
+ */
+double smoothRate(const double previous, const double current)
+{
+    return previous > 0 ? previous + RATE_SMOOTHING * (current - previous) : current;
+}
+
+} // namespace
+
+BtrfsMonitor::BtrfsMonitor(QObject *parent) : QObject(parent)
+{
+    m_timer = new QTimer(this);
+    m_timer->setSingleShot(true);
+    connect(m_timer, &QTimer::timeout, this, &BtrfsMonitor::startPoll);
+
+    m_watcher = new QFutureWatcher<Sample>(this);
+    connect(m_watcher, &QFutureWatcher<Sample>::finished, this, &BtrfsMonitor::pollFinished);
+}
+
+void BtrfsMonitor::poll()
+{
+    m_interval = 0;
+    startPoll();
+}
+
+void BtrfsMonitor::startPoll()
+{
+    if (m_mountpoint.isEmpty()) {
+        m_timer->stop();
+        return;
+    }
+
+    if (m_watcher->isRunning()) {
+        m_isPollQueued = true;
+        return;
+    }
+
+    m_timer->stop();
+    const QString mountpoint = m_mountpoint;
+    m_watcher->setFuture(QtConcurrent::run([mountpoint]() {
+        Sample sample;
+        sample.mountpoint = mountpoint;
+        sample.balance = Btrfs::balanceProgress(mountpoint);
+        sample.scrub = Btrfs::scrubProgress(mountpoint);
+        return sample;
+    }));
+}
+
+void BtrfsMonitor::pollFinished()
+{
+    Sample sample = m_watcher->result();
+
+    // The filesystem changed while the poll was running so it is stale
+    if (sample.mountpoint != m_mountpoint) {
+        m_isPollQueued = false;
+        startPoll();
+        return;
+    }
+
+    const double elapsed = m_sampleTimer.isValid() ? static_cast<double>(m_sampleTimer.restart()) / 1000 : 0;
+    if (!m_sampleTimer.isValid()) {
+        m_sampleTimer.start();
+    }
+
+    BalanceProgress &balance = sample.balance;
+    if (balance.isRunning && m_previous.balance.isRunning && elapsed > 0 && balance.completed >= m_previous.balance.completed) {
+        const double rate = static_cast<double>(balance.completed - m_previous.balance.completed) / elapsed;
+        balance.chunksPerSecond = smoothRate(m_previous.balance.chunksPerSecond, rate);
+        if (balance.chunksPerSecond > 0 && balance.expected > balance.completed) {
+            balance.etaSeconds = static_cast<qint64>(static_cast<double>(balance.expected - balance.completed) / balance.chunksPerSecond);
+        }
+    }
+
+    ScrubProgress &scrub = sample.scrub;
+    if (scrub.isRunning && m_previous.scrub.isRunning && elapsed > 0 && scrub.bytesScrubbed >= m_previous.scrub.bytesScrubbed) {
+        const double rate = static_cast<double>(scrub.bytesScrubbed - m_previous.scrub.bytesScrubbed) / elapsed;
+        scrub.bytesPerSecond = smoothRate(m_previous.scrub.bytesPerSecond, rate);
+        if (scrub.bytesPerSecond > 0 && scrub.bytesToScrub > scrub.bytesScrubbed) {
+            scrub.etaSeconds = static_cast<qint64>(static_cast<double>(scrub.bytesToScrub - scrub.bytesScrubbed) / scrub.bytesPerSecond);
+        }
+    }
+
+    m_previous = sample;
+    emit balanceProgressChanged(sample.balance);
+    emit scrubProgressChanged(sample.scrub);
+
+    if (m_isPollQueued) {
+        m_isPollQueued = false;
+        startPoll();
+        return;
+    }
+
+    // Back off while nothing is running so an idle filesystem is rarely queried
+    if (balance.isRunning || scrub.isRunning) {
+        m_interval = ACTIVE_INTERVAL;
+    } else {
+        m_interval = std::min(std::max(m_interval, ACTIVE_INTERVAL) * 2, IDLE_INTERVAL);
+    }
+    m_timer->start(m_interval);
+}
+
+void BtrfsMonitor::setMountpoint(const QString &mountpoint)
+{
+    if (mountpoint != m_mountpoint) {
+        m_mountpoint = mountpoint;
+        m_previous = Sample();
+        m_sampleTimer.invalidate();
+    }
+
+    poll();
+}
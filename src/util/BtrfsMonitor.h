@@ -0,0 +1,77 @@
+#ifndef BTRFSMONITOR_H
+#define BTRFSMONITOR_H
+
+#include "util/Btrfs.h"
+
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QObject>
+
+class QTimer;
+
+/**
+ * @brief The BtrfsMonitor class polls the balance and scrub progress of a filesystem on a worker thread
+ *
+ * The progress is read with ioctls so no processes are started.  While an operation is running the filesystem is polled
+ * every second, otherwise the interval doubles after every poll up to 30 seconds.
+ */
+class BtrfsMonitor : public QObject {
+    Q_OBJECT
+
+  public:
+    explicit BtrfsMonitor(QObject *parent = nullptr);
+
+    /**
+     * @brief Polls the filesystem straight away and goes back to the shortest interval
+     *
+     * Call this after starting or stopping an operation so the change is reported without waiting for the next poll.
+     */
+    void poll();
+
+    /**
+     * @brief Changes the filesystem which is monitored and polls it
+     * @param mountpoint - An absolute path to any mountpoint of the filesystem, an empty string stops the polling
+     */
+    void setMountpoint(const QString &mountpoint);
+
+  signals:
+    /**
+     * @brief Emitted after every poll with the progress of the balance
+     */
+    void balanceProgressChanged(const BalanceProgress &progress);
+
+    /**
+     * @brief Emitted after every poll with the progress of the scrub
+     */
+    void scrubProgressChanged(const ScrubProgress &progress);
+
+  private:
+    struct Sample {
+        QString mountpoint;
+        BalanceProgress balance;
+        ScrubProgress scrub;
+    };
+
+    /**
+     * @brief Fills in the rates and ETAs of the finished poll, reports it and schedules the next one
+     */
+    void pollFinished();
+
+    /**
+     * @brief Reads the progress on a worker thread unless a poll is already running, in which case another is queued
+     */
+    void startPoll();
+
+    QTimer *m_timer = nullptr;
+    QFutureWatcher<Sample> *m_watcher = nullptr;
+    QString m_mountpoint;
+    int m_interval = 0;
+    // Set when a poll is requested while another one is still running
+    bool m_isPollQueued = false;
+
+    // The previous sample, used to calculate the rates
+    Sample m_previous;
+    QElapsedTimer m_sampleTimer;
+};
+
+#endif // BTRFSMONITOR_H
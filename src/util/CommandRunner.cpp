@@ -0,0 +1,108 @@
+#include "util/CommandRunner.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+
+namespace {
+
+/**
+ * @brief Builds the key a command is recorded under, the output differs with stderr included so that is part of it
+ */
+QStringList commandKey(const QString &cmd, const QStringList &args, bool includeStderr)
+{
+    return QStringList() << (includeStderr ? QStringLiteral("stdout+stderr") : QStringLiteral("stdout")) << cmd << args;
+}
+
+} // namespace
+
+Result ProcessRunner::run(const QString &cmd, const QStringList &args, bool includeStderr, System::milliseconds timeout)
+{
+    QProcess proc;
+
+    if (includeStderr)
+        proc.setProcessChannelMode(QProcess::MergedChannels);
+
+    proc.start(cmd, args);
+
+    // waitForFinished() also fails when the process couldn't be started, only a process still running has timed out
+    proc.waitForFinished(static_cast<int>(timeout.count()));
+    return {proc.exitCode(), proc.readAllStandardOutput().trimmed(), proc.error() == QProcess::Timedout};
+}
+
+RecordingRunner::RecordingRunner(std::unique_ptr<CommandRunner> runner, const QString &filePath)
+    : m_runner(std::move(runner)), m_filePath(filePath)
+{
+}
+
+RecordingRunner::~RecordingRunner()
+{
+    QFile file(m_filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Failed to write the command recording to" << m_filePath << ":" << file.errorString();
+        return;
+    }
+
+    QJsonObject recording;
+    recording.insert("commands", m_commands);
+    file.write(QJsonDocument(recording).toJson());
+}
+
+Result RecordingRunner::run(const QString &cmd, const QStringList &args, bool includeStderr, System::milliseconds timeout)
+{
+    const Result result = m_runner->run(cmd, args, includeStderr, timeout);
+
+    QJsonObject command;
+    command.insert("command", cmd);
+    command.insert("args", QJsonArray::fromStringList(args));
+    command.insert("includeStderr", includeStderr);
+    command.insert("exitCode", result.exitCode);
+    command.insert("output", result.output);
+    command.insert("timedOut", result.timedOut);
+
+    QMutexLocker lock(&m_mutex);
+    m_commands.append(command);
+
+    return result;
+}
+
+ReplayRunner::ReplayRunner(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to read the command recording" << filePath << ":" << file.errorString();
+        return;
+    }
+
+    const QJsonArray commands = QJsonDocument::fromJson(file.readAll()).object().value("commands").toArray();
+    for (const QJsonValue &value : commands) {
+        const QJsonObject command = value.toObject();
+        QStringList args;
+        const QJsonArray argsArray = command.value("args").toArray();
+        for (const QJsonValue &arg : argsArray) {
+            args.append(arg.toString());
+        }
+
+        const QStringList key = commandKey(command.value("command").toString(), args, command.value("includeStderr").toBool());
+        m_results[key].enqueue(
+            {command.value("exitCode").toInt(-1), command.value("output").toString(), command.value("timedOut").toBool()});
+    }
+}
+
+Result ReplayRunner::run(const QString &cmd, const QStringList &args, bool includeStderr, System::milliseconds timeout)
+{
+    Q_UNUSED(timeout)
+
+    QMutexLocker lock(&m_mutex);
+
+    const auto it = m_results.find(commandKey(cmd, args, includeStderr));
+    if (it == m_results.end()) {
+        qWarning() << "No recorded result for" << cmd << args;
+        return Result();
+    }
+
+    // The last result is kept so the command keeps returning it
+    return it->size() > 1 ? it->dequeue() : it->head();
+}
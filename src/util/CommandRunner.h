@@ -0,0 +1,90 @@
+#ifndef COMMANDRUNNER_H
+#define COMMANDRUNNER_H
+
+#include "util/System.h"
+
+#include <QHash>
+#include <QJsonArray>
+#include <QMutex>
+#include <QQueue>
+
+#include <memory>
+
+/**
+ * @brief The CommandRunner class is the interface System::runCmd uses to run commands
+ *
+ * The default implementation starts a process.  The recording and replaying implementations make it possible to
+ * capture the output of the btrfs and snapper commands on a real system and feed it back later without root or any
+ * processes being started.
+ *
+ * Only what still goes through System::runCmd can be replayed.  The filesystems, subvolumes, qgroups and snapper
+ * snapshots are read with ioctls and from the files directly, so Btrfs::loadVolumes and Snapper::load still need the
+ * real filesystems.  A replay covers the command line fallbacks used when those reads fail, the snapper commands used
+ * for configs that can't be read directly and the commands that change things such as snapper, systemctl and the
+ * btrfs balance, scrub and quota commands.
+ */
+class CommandRunner {
+  public:
+    virtual ~CommandRunner() = default;
+
+    /**
+     * @brief Runs a command, the parameters are the same as System::runCmd
+     * @return A Result containing the exit code and the output from the running the command
+     */
+    virtual Result run(const QString &cmd, const QStringList &args, bool includeStderr, System::milliseconds timeout) = 0;
+};
+
+/**
+ * @brief The ProcessRunner class runs commands with QProcess
+ */
+class ProcessRunner : public CommandRunner {
+  public:
+    Result run(const QString &cmd, const QStringList &args, bool includeStderr, System::milliseconds timeout) override;
+};
+
+/**
+ * @brief The RecordingRunner class runs commands with another runner and records their results
+ *
+ * The recording is written to a JSON file when the runner is destroyed.
+ */
+class RecordingRunner : public CommandRunner {
+  public:
+    /**
+     * @param runner - The runner which actually runs the commands
+     * @param filePath - The file the recording is written to
+     */
+    RecordingRunner(std::unique_ptr<CommandRunner> runner, const QString &filePath);
+    ~RecordingRunner() override;
+
+    Result run(const QString &cmd, const QStringList &args, bool includeStderr, System::milliseconds timeout) override;
+
+  private:
+    std::unique_ptr<CommandRunner> m_runner;
+    QString m_filePath;
+    QMutex m_mutex;
+    QJsonArray m_commands;
+};
+
+/**
+ * @brief The ReplayRunner class returns the results from a file written by RecordingRunner instead of running anything
+ *
+ * Each time a command is run the next result recorded for it is returned and the last one is repeated once they run
+ * out, so a command whose output changed during the recording replays the same way.  Commands which weren't recorded
+ * fail with an exit code of -1.
+ */
+class ReplayRunner : public CommandRunner {
+  public:
+    /**
+     * @param filePath - A recording written by RecordingRunner
+     */
+    explicit ReplayRunner(const QString &filePath);
+
+    Result run(const QString &cmd, const QStringList &args, bool includeStderr, System::milliseconds timeout) override;
+
+  private:
+    QMutex m_mutex;
+    // The recorded results of each command keyed by commandKey()
+    QHash<QStringList, QQueue<Result>> m_results;
+};
+
+#endif // COMMANDRUNNER_H
@@ -0,0 +1,442 @@
+#include "util/Diff.h"
+#include "util/Trace.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// Like git, a file with a NUL byte near the start is treated as binary
+constexpr std::string_view::size_type BINARY_PROBE_SIZE = 8000;
+
+// The number of edits searched for before splitting a range at the furthest point reached instead
+constexpr int DIFF_COST_LIMIT = 1024;
+
+// Set on the id of a last line without a newline so it doesn't match the same line with one
+constexpr uint32_t NO_NEWLINE_ID = 0x80000000;
+
+/**
+ * @brief The MappedFile class maps a file into memory, files which can't be mapped are read instead
+ */
+class MappedFile {
+  public:
+    /**
+     * @brief Opens and maps a file
+     * @param path - The path of the file
+     * @param error - Set to the reason when the file can't be read
+     * @return True if the file could be read
+     */
+    bool open(const QString &path, QString &error)
+    {
+        m_file.setFileName(path);
+        if (!m_file.open(QIODevice::ReadOnly)) {
+            error = m_file.errorString();
+            return false;
+        }
+
+        const qint64 size = m_file.size();
+        if (size > 0) {
+            const uchar *data = m_file.map(0, size);
+            if (data != nullptr) {
+                m_data = std::string_view(reinterpret_cast<const char *>(data), static_cast<size_t>(size));
+                return true;
+            }
+        }
+
+        // Empty files can't be mapped and some files report a size of 0 but aren't empty
+        m_buffer = m_file.readAll();
+        m_data = std::string_view(m_buffer.constData(), static_cast<size_t>(m_buffer.size()));
+        return true;
+    }
+
+    std::string_view data() const { return m_data; }
+
+  private:
+    QFile m_file;
+    QByteArray m_buffer;
+    std::string_view m_data;
+};
+
+/**
+ * @brief The lines of a file and an id for each of them, lines with the same contents share an id
+ */
+struct Lines {
+    std::vector<std::string_view> text;
+    std::vector<uint32_t> ids;
+    bool hasFinalNewline = true;
+};
+
+/**
+ * @brief Splits a file into lines and gives every distinct line an id shared by both files
+ */
+Lines splitLines(std::string_view data, std::unordered_map<std::string_view, uint32_t> &lineIds)
+{
+    Lines lines;
+    lines.text.reserve(static_cast<size_t>(std::count(data.begin(), data.end(), '\n')) + 1);
+
+    size_t start = 0;
+    while (start < data.size()) {
+        size_t end = data.find('\n', start);
+        if (end == std::string_view::npos) {
+            end = data.size();
+            lines.hasFinalNewline = false;
+        }
+        lines.text.push_back(data.substr(start, end - start));
+        start = end + 1;
+    }
+
+    lines.ids.reserve(lines.text.size());
+    for (const std::string_view &line : lines.text) {
+        lines.ids.push_back(lineIds.emplace(line, static_cast<uint32_t>(lineIds.size())).first->second);
+    }
+    if (!lines.hasFinalNewline) {
+        lines.ids.back() |= NO_NEWLINE_ID;
+    }
+
+    return lines;
+}
+
+/**
+ * @brief The MyersDiff class finds the lines which differ between two files with the linear space variant of Myers'
+ * algorithm
+ */
+class MyersDiff {
+  public:
+    /**
+     * @param a - The line ids of the old file
+     * @param b - The line ids of the new file
+     */
+    MyersDiff(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b)
+        : m_a(a), m_b(b), m_isDeleted(a.size(), false), m_isInserted(b.size(), false)
+    {
+        const size_t maxD = (a.size() + b.size() + 1) / 2 + 1;
+        m_forward.resize(2 * maxD + 2);
+        m_reverse.resize(2 * maxD + 2);
+        compare(0, static_cast<int>(a.size()), 0, static_cast<int>(b.size()));
+    }
+
+    // True for each line of the old file which isn't in the new file
+    const std::vector<bool> &isDeleted() const { return m_isDeleted; }
+    // True for each line of the new file which isn't in the old file
+    const std::vector<bool> &isInserted() const { return m_isInserted; }
+
+  private:
+    /**
+     * @brief Marks the lines of a[aLo, aHi) and b[bLo, bHi) which aren't part of a longest common subsequence
+     */
+    void compare(int aLo, int aHi, int bLo, int bHi)
+    {
+        while (true) {
+            // Lines in common at either end are never part of the difference
+            while (aLo < aHi && bLo < bHi && m_a[aLo] == m_b[bLo]) {
+                aLo++;
+                bLo++;
+            }
+            while (aLo < aHi && bLo < bHi && m_a[aHi - 1] == m_b[bHi - 1]) {
+                aHi--;
+                bHi--;
+            }
+
+            if (aLo == aHi) {
+                std::fill(m_isInserted.begin() + bLo, m_isInserted.begin() + bHi, true);
+                return;
+            }
+            if (bLo == bHi) {
+                std::fill(m_isDeleted.begin() + aLo, m_isDeleted.begin() + aHi, true);
+                return;
+            }
+
+            int x = 0;
+            int y = 0;
+            split(aLo, aHi, bLo, bHi, x, y);
+
+            // Recurse into the first half and loop on the second to keep the recursion shallow
+            compare(aLo, x, bLo, y);
+            aLo = x;
+            bLo = y;
+        }
+    }
+
+    /**
+     * @brief Finds a point (@p x, @p y) on an optimal path through a[aLo, aHi) and b[bLo, bHi)
+     *
+     * Both ranges must be non empty and differ in their first and last lines.  The forward and reverse searches run
+     * until they meet, the point is where the forward path ends when they do.
+     */
+    void split(int aLo, int aHi, int bLo, int bHi, int &x, int &y)
+    {
+        const int n = aHi - aLo;
+        const int m = bHi - bLo;
+        const int delta = n - m;
+        const bool isOdd = (delta & 1) != 0;
+        const int maxD = (n + m + 1) / 2;
+        const int offset = maxD + 1;
+
+        // The furthest x reached on each diagonal, -1 until the diagonal is reached
+        std::fill(m_forward.begin(), m_forward.begin() + 2 * offset + 1, -1);
+        std::fill(m_reverse.begin(), m_reverse.begin() + 2 * offset + 1, -1);
+        int *forward = m_forward.data() + offset;
+        int *reverse = m_reverse.data() + offset;
+        forward[1] = 0;
+        reverse[1] = 0;
+
+        // Diagonals which ran off the edge of the grid are skipped
+        int forwardStart = 0;
+        int forwardEnd = 0;
+        int reverseStart = 0;
+        int reverseEnd = 0;
+
+        for (int d = 0; d <= maxD; d++) {
+            if (d > DIFF_COST_LIMIT) {
+                // Too expensive, settle for the forward point which got furthest
+                int best = 0;
+                for (int k = -d + 1 + forwardStart; k <= d - 1 - forwardEnd; k += 2) {
+                    const int fx = forward[k];
+                    const int fy = fx - k;
+                    if (fx >= 0 && fx <= n && fy >= 0 && fy <= m && fx + fy > best && fx + fy < n + m) {
+                        best = fx + fy;
+                        x = aLo + fx;
+                        y = bLo + fy;
+                    }
+                }
+                if (best > 0) {
+                    return;
+                }
+            }
+
+            for (int k = -d + forwardStart; k <= d - forwardEnd; k += 2) {
+                int fx = (k == -d || (k != d && forward[k - 1] < forward[k + 1])) ? forward[k + 1] : forward[k - 1] + 1;
+                int fy = fx - k;
+                while (fx < n && fy < m && m_a[aLo + fx] == m_b[bLo + fy]) {
+                    fx++;
+                    fy++;
+                }
+                forward[k] = fx;
+
+                if (fx > n) {
+                    forwardEnd += 2;
+                } else if (fy > m) {
+                    forwardStart += 2;
+                } else if (isOdd) {
+                    const int c = delta - k;
+                    if (c >= -offset && c <= offset && reverse[c] != -1 && fx >= n - reverse[c]) {
+                        x = aLo + fx;
+                        y = bLo + fy;
+                        return;
+                    }
+                }
+            }
+
+            for (int c = -d + reverseStart; c <= d - reverseEnd; c += 2) {
+                int rx = (c == -d || (c != d && reverse[c - 1] < reverse[c + 1])) ? reverse[c + 1] : reverse[c - 1] + 1;
+                int ry = rx - c;
+                while (rx < n && ry < m && m_a[aHi - 1 - rx] == m_b[bHi - 1 - ry]) {
+                    rx++;
+                    ry++;
+                }
+                reverse[c] = rx;
+
+                if (rx > n) {
+                    reverseEnd += 2;
+                } else if (ry > m) {
+                    reverseStart += 2;
+                } else if (!isOdd) {
+                    const int k = delta - c;
+                    if (k >= -offset && k <= offset && forward[k] != -1 && forward[k] >= n - rx) {
+                        x = aLo + forward[k];
+                        y = bLo + forward[k] - k;
+                        return;
+                    }
+                }
+            }
+        }
+
+        // The searches always meet by maxD but splitting in the middle would still be correct
+        x = aLo + n / 2;
+        y = bLo + m / 2;
+    }
+
+    const std::vector<uint32_t> &m_a;
+    const std::vector<uint32_t> &m_b;
+    std::vector<bool> m_isDeleted;
+    std::vector<bool> m_isInserted;
+    std::vector<int> m_forward;
+    std::vector<int> m_reverse;
+};
+
+/**
+ * @brief A run of lines removed from the old file and the lines added in their place
+ */
+struct Change {
+    int aStart = 0;
+    int aCount = 0;
+    int bStart = 0;
+    int bCount = 0;
+};
+
+/**
+ * @brief Formats the start and length of a hunk the way diff -u does
+ */
+QString hunkRange(int start, int count)
+{
+    // A single line omits the count and an empty range is numbered by the line before it
+    if (count == 1) {
+        return QString::number(start + 1);
+    }
+    return QString("%1,%2").arg(count == 0 ? start : start + 1).arg(count);
+}
+
+/**
+ * @brief Formats the header line naming one of the files
+ */
+QString fileHeader(const QString &prefix, const QString &path)
+{
+    return prefix + path + "\t" + QFileInfo(path).lastModified().toString(Qt::ISODateWithMs);
+}
+
+/**
+ * @brief Writes the unified diff of two files once their changed lines are known
+ */
+QStringList unifiedDiff(const QString &oldPath, const Lines &a, const std::vector<bool> &isDeleted, const QString &newPath, const Lines &b,
+                        const std::vector<bool> &isInserted, int context)
+{
+    const int aSize = static_cast<int>(a.text.size());
+    const int bSize = static_cast<int>(b.text.size());
+
+    // Unchanged lines pair up in order so both files can be walked together
+    std::vector<Change> changes;
+    int i = 0;
+    int j = 0;
+    while (i < aSize || j < bSize) {
+        if ((i < aSize && isDeleted[i]) || (j < bSize && isInserted[j])) {
+            Change change{i, 0, j, 0};
+            while (i < aSize && isDeleted[i]) {
+                i++;
+                change.aCount++;
+            }
+            while (j < bSize && isInserted[j]) {
+                j++;
+                change.bCount++;
+            }
+            changes.push_back(change);
+        } else {
+            i++;
+            j++;
+        }
+    }
+
+    QStringList lines = {fileHeader("--- ", oldPath), fileHeader("+++ ", newPath)};
+
+    const auto appendLine = [&lines](const QChar &prefix, const Lines &file, int line) {
+        const std::string_view text = file.text[line];
+        lines.append(prefix + QString::fromUtf8(text.data(), static_cast<int>(text.size())));
+        if (!file.hasFinalNewline && line == static_cast<int>(file.text.size()) - 1) {
+            lines.append("\\ No newline at end of file");
+        }
+    };
+
+    size_t first = 0;
+    while (first < changes.size()) {
+        // Changes close enough for their context to touch share a hunk
+        size_t last = first;
+        while (last + 1 < changes.size() &&
+               changes[last + 1].aStart - (changes[last].aStart + changes[last].aCount) <= 2 * context) {
+            last++;
+        }
+
+        const Change &firstChange = changes[first];
+        const Change &lastChange = changes[last];
+        const int before = std::min(context, firstChange.aStart);
+        const int after = std::min(context, aSize - (lastChange.aStart + lastChange.aCount));
+        const int aStart = firstChange.aStart - before;
+        const int bStart = firstChange.bStart - before;
+        const int aCount = lastChange.aStart + lastChange.aCount + after - aStart;
+        const int bCount = lastChange.bStart + lastChange.bCount + after - bStart;
+        lines.append(QString("@@ -%1 +%2 @@").arg(hunkRange(aStart, aCount), hunkRange(bStart, bCount)));
+
+        int line = aStart;
+        for (size_t c = first; c <= last; c++) {
+            const Change &change = changes[c];
+            for (; line < change.aStart; line++) {
+                appendLine(' ', a, line);
+            }
+            for (int k = 0; k < change.aCount; k++) {
+                appendLine('-', a, change.aStart + k);
+            }
+            for (int k = 0; k < change.bCount; k++) {
+                appendLine('+', b, change.bStart + k);
+            }
+            line = change.aStart + change.aCount;
+        }
+        for (const int end = line + after; line < end; line++) {
+            appendLine(' ', a, line);
+        }
+
+        first = last + 1;
+    }
+
+    return lines;
+}
+
+} // namespace
+
+DiffResult Diff::compareFiles(const QString &oldPath, const QString &newPath, int context)
+{
+    TraceSpan span("Diff::compareFiles", "diff");
+    DiffResult result;
+
+    // The same inode is the same file, there is no need to read it
+    struct stat oldStat = {};
+    struct stat newStat = {};
+    if (stat(oldPath.toUtf8(), &oldStat) == 0 && stat(newPath.toUtf8(), &newStat) == 0 && oldStat.st_dev == newStat.st_dev &&
+        oldStat.st_ino == newStat.st_ino) {
+        result.status = DiffResult::Status::Identical;
+        return result;
+    }
+
+    MappedFile oldFile;
+    MappedFile newFile;
+    QString error;
+    if (!oldFile.open(oldPath, error)) {
+        result.error = tr("Failed to read %1: %2").arg(oldPath, error);
+        return result;
+    }
+    if (!newFile.open(newPath, error)) {
+        result.error = tr("Failed to read %1: %2").arg(newPath, error);
+        return result;
+    }
+
+    const std::string_view oldData = oldFile.data();
+    const std::string_view newData = newFile.data();
+    span.setArg("bytes", static_cast<qint64>(oldData.size() + newData.size()));
+
+    if (oldData == newData) {
+        result.status = DiffResult::Status::Identical;
+        return result;
+    }
+
+    if (oldData.substr(0, BINARY_PROBE_SIZE).find('\0') != std::string_view::npos ||
+        newData.substr(0, BINARY_PROBE_SIZE).find('\0') != std::string_view::npos) {
+        result.status = DiffResult::Status::Binary;
+        return result;
+    }
+
+    std::unordered_map<std::string_view, uint32_t> lineIds;
+    const Lines oldLines = splitLines(oldData, lineIds);
+    const Lines newLines = splitLines(newData, lineIds);
+    span.setArg("lines", static_cast<qint64>(oldLines.text.size() + newLines.text.size()));
+
+    const MyersDiff diff(oldLines.ids, newLines.ids);
+    result.status = DiffResult::Status::Different;
+    result.lines = unifiedDiff(oldPath, oldLines, diff.isDeleted(), newPath, newLines, diff.isInserted(), context);
+
+    return result;
+}
@@ -0,0 +1,42 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+#include <QCoreApplication>
+#include <QString>
+#include <QStringList>
+
+/**
+ * @brief The outcome of comparing two files with Diff::compareFiles()
+ */
+struct DiffResult {
+    enum class Status { Identical, Different, Binary, Failed };
+
+    Status status = Status::Failed;
+    // The differences in unified format, the same as diff -u prints them, when the status is Different
+    QStringList lines;
+    // Why the comparison failed when the status is Failed
+    QString error;
+};
+
+/**
+ * @brief The Diff class compares files in memory instead of running diff
+ *
+ * Both files are mapped rather than read, identical and binary files are recognized before any lines are split and the
+ * lines are compared with the linear space variant of Myers' algorithm.  Very different files fall back to a quicker
+ * diff which can be longer than the shortest one.
+ */
+class Diff {
+    Q_DECLARE_TR_FUNCTIONS(Diff)
+
+  public:
+    /**
+     * @brief Compares two files line by line
+     * @param oldPath - The path of the file shown as removed lines
+     * @param newPath - The path of the file shown as added lines
+     * @param context - The number of unchanged lines shown around each change
+     * @return A DiffResult holding the unified diff when the files differ
+     */
+    static DiffResult compareFiles(const QString &oldPath, const QString &newPath, int context = 3);
+};
+
+#endif // DIFF_H
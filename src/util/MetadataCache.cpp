@@ -0,0 +1,253 @@
+#include "util/MetadataCache.h"
+#include "util/Settings.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+namespace {
+
+// Identifies the cache file and the layout of its contents, bump the version whenever the layout changes
+constexpr quint32 CACHE_MAGIC = 0x42544143;
+constexpr quint32 CACHE_VERSION = 1;
+
+constexpr const char *CACHE_FILE = "metadata.cache";
+constexpr const char *DEFAULT_CACHE_DIR = "/var/cache/btrfs-assistant";
+
+void writeSubvolume(QDataStream &stream, const Subvolume &subvol)
+{
+    stream << quint64(subvol.id) << quint64(subvol.parentId) << subvol.subvolName << subvol.uuid << subvol.parentUuid
+           << subvol.receivedUuid << quint64(subvol.generation) << quint64(subvol.size) << quint64(subvol.exclusive)
+           << quint64(subvol.flags) << subvol.createdAt;
+}
+
+Subvolume readSubvolume(QDataStream &stream, const QString &uuid)
+{
+    Subvolume subvol;
+    quint64 id, parentId, generation, size, exclusive, flags;
+    stream >> id >> parentId >> subvol.subvolName >> subvol.uuid >> subvol.parentUuid >> subvol.receivedUuid >> generation >> size >>
+        exclusive >> flags >> subvol.createdAt;
+    subvol.id = id;
+    subvol.parentId = parentId;
+    subvol.generation = generation;
+    subvol.size = size;
+    subvol.exclusive = exclusive;
+    subvol.flags = flags;
+    subvol.filesystemUuid = uuid;
+    return subvol;
+}
+
+void writeSnapperSnapshot(QDataStream &stream, const SnapperSnapshot &snapshot)
+{
+    stream << quint32(snapshot.number) << snapshot.time << snapshot.desc << snapshot.type << snapshot.cleanup;
+}
+
+SnapperSnapshot readSnapperSnapshot(QDataStream &stream)
+{
+    SnapperSnapshot snapshot;
+    quint32 number;
+    stream >> number >> snapshot.time >> snapshot.desc >> snapshot.type >> snapshot.cleanup;
+    snapshot.number = number;
+    return snapshot;
+}
+
+} // namespace
+
+MetadataCache &MetadataCache::instance()
+{
+    static MetadataCache instance;
+    return instance;
+}
+
+MetadataCache::MetadataCache()
+{
+    const QString cacheDir = Settings::instance().value("cache_dir", DEFAULT_CACHE_DIR).toString();
+    if (!cacheDir.isEmpty()) {
+        m_filePath = QDir(cacheDir).filePath(CACHE_FILE);
+        read();
+    }
+}
+
+void MetadataCache::read()
+{
+    QFile file(m_filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_12);
+
+    quint32 magic, version;
+    stream >> magic >> version;
+    if (magic != CACHE_MAGIC || version != CACHE_VERSION) {
+        qDebug() << "Ignoring the metadata cache in" << m_filePath << "because it was written by another version";
+        return;
+    }
+
+    QHash<QString, CachedFilesystem> filesystems;
+    quint32 filesystemCount;
+    stream >> filesystemCount;
+    for (quint32 i = 0; i < filesystemCount && stream.status() == QDataStream::Ok; i++) {
+        QString uuid;
+        quint64 generation;
+        quint32 subvolCount;
+        stream >> uuid >> generation >> subvolCount;
+
+        CachedFilesystem &filesystem = filesystems[uuid];
+        filesystem.generation = generation;
+        for (quint32 j = 0; j < subvolCount && stream.status() == QDataStream::Ok; j++) {
+            const Subvolume subvol = readSubvolume(stream, uuid);
+            filesystem.subvolumes.insert(subvol.id, subvol);
+        }
+    }
+
+    QHash<QPair<QString, uint64_t>, CachedSnapperSnapshot> snapperSnapshots;
+    quint32 snapshotCount;
+    stream >> snapshotCount;
+    for (quint32 i = 0; i < snapshotCount && stream.status() == QDataStream::Ok; i++) {
+        QString uuid;
+        quint64 subvolid;
+        CachedSnapperSnapshot cached;
+        stream >> uuid >> subvolid >> cached.createdAt >> cached.modified;
+        cached.snapshot = readSnapperSnapshot(stream);
+        snapperSnapshots.insert({uuid, subvolid}, cached);
+    }
+
+    // A truncated file is thrown away as a whole rather than trusting part of it
+    if (stream.status() != QDataStream::Ok) {
+        qWarning() << "Ignoring the corrupt metadata cache in" << m_filePath;
+        return;
+    }
+
+    m_filesystems = filesystems;
+    m_snapperSnapshots = snapperSnapshots;
+    qDebug() << "Read the metadata cache with" << snapperSnapshots.count() << "snapper snapshots in" << timer.elapsed() << "ms";
+}
+
+void MetadataCache::removeFilesystem(const QString &uuid)
+{
+    QMutexLocker lock(&m_mutex);
+
+    if (m_filesystems.remove(uuid) > 0) {
+        m_isDirty = true;
+    }
+    for (auto it = m_snapperSnapshots.begin(); it != m_snapperSnapshots.end();) {
+        if (it.key().first == uuid) {
+            it = m_snapperSnapshots.erase(it);
+            m_isDirty = true;
+        } else {
+            ++it;
+        }
+    }
+}
+
+void MetadataCache::save()
+{
+    QMutexLocker lock(&m_mutex);
+    if (!m_isDirty || m_filePath.isEmpty()) {
+        return;
+    }
+
+    if (!QDir().mkpath(QFileInfo(m_filePath).absolutePath())) {
+        qWarning() << "Failed to create the directory for" << m_filePath;
+        return;
+    }
+
+    // Written to a temporary file and renamed so a crash can never leave a partial cache behind
+    QSaveFile file(m_filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to write the metadata cache to" << m_filePath << ":" << file.errorString();
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_12);
+    stream << CACHE_MAGIC << CACHE_VERSION;
+
+    stream << quint32(m_filesystems.count());
+    for (auto it = m_filesystems.cbegin(); it != m_filesystems.cend(); ++it) {
+        stream << it.key() << quint64(it->generation) << quint32(it->subvolumes.count());
+        for (const Subvolume &subvol : it->subvolumes) {
+            writeSubvolume(stream, subvol);
+        }
+    }
+
+    stream << quint32(m_snapperSnapshots.count());
+    for (auto it = m_snapperSnapshots.cbegin(); it != m_snapperSnapshots.cend(); ++it) {
+        stream << it.key().first << quint64(it.key().second) << it->createdAt << it->modified;
+        writeSnapperSnapshot(stream, it->snapshot);
+    }
+
+    if (file.commit()) {
+        m_isDirty = false;
+    } else {
+        qWarning() << "Failed to write the metadata cache to" << m_filePath << ":" << file.errorString();
+    }
+}
+
+std::optional<SnapperSnapshot> MetadataCache::snapperSnapshot(const QString &uuid, uint64_t subvolid, const QDateTime &createdAt,
+                                                              qint64 modified)
+{
+    QMutexLocker lock(&m_mutex);
+
+    const auto it = m_snapperSnapshots.constFind({uuid, subvolid});
+    if (it == m_snapperSnapshots.cend() || it->createdAt != createdAt || it->modified != modified) {
+        return std::nullopt;
+    }
+
+    return it->snapshot;
+}
+
+void MetadataCache::setSnapperSnapshot(const QString &uuid, uint64_t subvolid, const QDateTime &createdAt, qint64 modified,
+                                       const SnapperSnapshot &snapshot)
+{
+    QMutexLocker lock(&m_mutex);
+    m_snapperSnapshots.insert({uuid, subvolid}, {createdAt, modified, snapshot});
+    m_isDirty = true;
+}
+
+void MetadataCache::setSubvolumes(const QString &uuid, uint64_t generation, const SubvolumeMap &subvols)
+{
+    QMutexLocker lock(&m_mutex);
+
+    CachedFilesystem &filesystem = m_filesystems[uuid];
+    // Nothing can have changed if the generation is the same
+    if (generation > 0 && filesystem.generation == generation) {
+        return;
+    }
+    filesystem.generation = generation;
+    filesystem.subvolumes = subvols;
+
+    // Drop the snapper metadata of snapshots which no longer exist so the cache doesn't grow forever
+    for (auto it = m_snapperSnapshots.begin(); it != m_snapperSnapshots.end();) {
+        if (it.key().first == uuid && !subvols.contains(it.key().second)) {
+            it = m_snapperSnapshots.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    m_isDirty = true;
+}
+
+bool MetadataCache::subvolumes(const QString &uuid, uint64_t &generation, SubvolumeMap &subvols)
+{
+    QMutexLocker lock(&m_mutex);
+
+    const auto it = m_filesystems.constFind(uuid);
+    if (it == m_filesystems.cend()) {
+        return false;
+    }
+
+    generation = it->generation;
+    subvols = it->subvolumes;
+    return true;
+}
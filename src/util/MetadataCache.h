@@ -0,0 +1,104 @@
+#ifndef METADATACACHE_H
+#define METADATACACHE_H
+
+#include "util/Snapper.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+
+#include <optional>
+
+/**
+ * @brief The MetadataCache class is a singleton that keeps the subvolumes and the snapper metadata between runs
+ *
+ * The cache is a single file read on first use and written by save() when something changed.  The subvolumes of a
+ * filesystem are stored with the filesystem generation they were read at so only the changes since then need to be
+ * read.  The snapper metadata is keyed by filesystem UUID and subvolume id and is only used while the creation time of
+ * the subvolume and the modification time of its info.xml still match.
+ */
+class MetadataCache {
+  public:
+    /**
+     * @brief Gets a reference to the MetadataCache object
+     */
+    static MetadataCache &instance();
+
+    /**
+     * @brief Drops everything cached for a filesystem
+     * @param uuid - The UUID of the filesystem
+     */
+    void removeFilesystem(const QString &uuid);
+
+    /**
+     * @brief Writes the cache to disk if anything changed since it was read or last saved
+     */
+    void save();
+
+    /**
+     * @brief Looks up the cached snapper metadata of a snapshot
+     * @param uuid - The UUID of the filesystem holding the snapshot
+     * @param subvolid - The ID of the snapshot subvolume
+     * @param createdAt - The creation time of the snapshot subvolume
+     * @param modified - The modification time of the info.xml in msecs since the epoch
+     * @return The cached metadata or std::nullopt if it isn't cached or is out of date
+     */
+    std::optional<SnapperSnapshot> snapperSnapshot(const QString &uuid, uint64_t subvolid, const QDateTime &createdAt, qint64 modified);
+
+    /**
+     * @brief Stores the snapper metadata of a snapshot, see snapperSnapshot() for the parameters
+     */
+    void setSnapperSnapshot(const QString &uuid, uint64_t subvolid, const QDateTime &createdAt, qint64 modified,
+                            const SnapperSnapshot &snapshot);
+
+    /**
+     * @brief Replaces the cached subvolumes of a filesystem
+     * @param uuid - The UUID of the filesystem
+     * @param generation - The filesystem generation read before the subvolumes were read
+     * @param subvols - The subvolumes of the filesystem
+     */
+    void setSubvolumes(const QString &uuid, uint64_t generation, const SubvolumeMap &subvols);
+
+    /**
+     * @brief Looks up the cached subvolumes of a filesystem
+     * @param uuid - The UUID of the filesystem
+     * @param generation - Set to the filesystem generation the subvolumes were read at
+     * @param subvols - Set to the cached subvolumes
+     * @return True if the filesystem is cached
+     */
+    bool subvolumes(const QString &uuid, uint64_t &generation, SubvolumeMap &subvols);
+
+  private:
+    MetadataCache();
+    // Delete the copy constructor and the assignment operator
+    MetadataCache(MetadataCache const &) = delete;
+    void operator=(MetadataCache const &) = delete;
+
+    struct CachedFilesystem {
+        uint64_t generation = 0;
+        SubvolumeMap subvolumes;
+    };
+
+    struct CachedSnapperSnapshot {
+        QDateTime createdAt;
+        qint64 modified = -1;
+        SnapperSnapshot snapshot;
+    };
+
+    /**
+     * @brief Reads the cache file, an unreadable or outdated file leaves the cache empty
+     */
+    void read();
+
+    // The absolute path to the cache file, empty when the cache is disabled
+    QString m_filePath;
+    bool m_isDirty = false;
+    QMutex m_mutex;
+
+    // The key is the filesystem UUID
+    QHash<QString, CachedFilesystem> m_filesystems;
+    // The key is the filesystem UUID and the subvolume id of the snapshot
+    QHash<QPair<QString, uint64_t>, CachedSnapperSnapshot> m_snapperSnapshots;
+};
+
+#endif // METADATACACHE_H
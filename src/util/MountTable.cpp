@@ -0,0 +1,243 @@
+#include "util/MountTable.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QUuid>
+#include <fcntl.h>
+#include <linux/btrfs.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace {
+
+/**
+ * @brief Decodes the octal escapes the kernel uses for whitespace and backslashes in mountinfo fields
+ * @param field - A single raw field from mountinfo
+ * @return The decoded field
+ */
+QString unescapeField(const QByteArray &field)
+{
+    QByteArray decoded;
+    decoded.reserve(field.size());
+    for (int i = 0; i < field.size(); ++i) {
+        if (field.at(i) == '\\' && i + 3 < field.size()) {
+            bool ok = false;
+            const int value = field.mid(i + 1, 3).toInt(&ok, 8);
+            if (ok) {
+                decoded.append(static_cast<char>(value));
+                i += 3;
+                continue;
+            }
+        }
+        decoded.append(field.at(i));
+    }
+    return QString::fromLocal8Bit(decoded);
+}
+
+/**
+ * @brief Maps each block device used by a btrfs filesystem to the filesystem UUID using sysfs
+ * @return A QHash where the key is the kernel name of the device, for example sda2 or dm-0, and the value is the UUID
+ */
+QHash<QString, QString> readSysfsDevices()
+{
+    QHash<QString, QString> devices;
+    const QDir btrfsDir(QStringLiteral("/sys/fs/btrfs"));
+    const QStringList uuids = btrfsDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QString &uuid : uuids) {
+        const QDir devicesDir(btrfsDir.filePath(uuid + QStringLiteral("/devices")));
+        const QStringList names = devicesDir.entryList(QDir::AllEntries | QDir::NoDotAndDotDot);
+        for (const QString &name : names) {
+            devices.insert(name, uuid);
+        }
+    }
+    return devices;
+}
+
+/**
+ * @brief Reads the UUID of the btrfs filesystem mounted at @p target with BTRFS_IOC_FS_INFO
+ * @param target - The absolute path of a btrfs mountpoint
+ * @return The UUID or a default constructed QString on failure
+ */
+QString readUuidIoctl(const QString &target)
+{
+    const int fd = open(target.toLocal8Bit(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return QString();
+    }
+
+    struct btrfs_ioctl_fs_info_args fsInfo = {};
+    const int ret = ioctl(fd, BTRFS_IOC_FS_INFO, &fsInfo);
+    close(fd);
+    if (ret != 0) {
+        return QString();
+    }
+
+    return QUuid::fromRfc4122(QByteArray(reinterpret_cast<const char *>(fsInfo.fsid), BTRFS_FSID_SIZE)).toString(QUuid::WithoutBraces);
+}
+
+} // namespace
+
+MountTable &MountTable::instance()
+{
+    static MountTable instance;
+    return instance;
+}
+
+MountTable::MountTable() { m_fd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC); }
+
+MountTable::~MountTable()
+{
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+QString MountTable::findAnyMountpoint(const QString &uuid)
+{
+    QMutexLocker lock(&m_mutex);
+    refresh();
+
+    const QVector<int> positions = m_byUuid.value(uuid);
+    return positions.isEmpty() ? QString() : m_entries.at(positions.first()).target;
+}
+
+QString MountTable::findMountpoint(const QString &uuid, uint64_t subvolid)
+{
+    QMutexLocker lock(&m_mutex);
+    refresh();
+
+    const QVector<int> positions = m_bySubvolid.value(subvolid);
+    for (const int position : positions) {
+        if (m_entries.at(position).uuid == uuid) {
+            return m_entries.at(position).target;
+        }
+    }
+
+    return QString();
+}
+
+QString MountTable::findUuid(const QString &target)
+{
+    QMutexLocker lock(&m_mutex);
+    refresh();
+
+    const int position = m_byTarget.value(QDir::cleanPath(target), -1);
+    return position == -1 ? QString() : m_entries.at(position).uuid;
+}
+
+bool MountTable::hasBtrfs()
+{
+    QMutexLocker lock(&m_mutex);
+    refresh();
+
+    return !m_entries.isEmpty();
+}
+
+void MountTable::invalidate()
+{
+    QMutexLocker lock(&m_mutex);
+    m_isStale = true;
+}
+
+QStringList MountTable::mountpoints()
+{
+    QMutexLocker lock(&m_mutex);
+    refresh();
+
+    QStringList targets;
+    for (const MountEntry &entry : qAsConst(m_entries)) {
+        targets.append(entry.target);
+    }
+    return targets;
+}
+
+void MountTable::parse()
+{
+    m_entries.clear();
+    m_byUuid.clear();
+    m_bySubvolid.clear();
+    m_byTarget.clear();
+
+    if (m_fd < 0 || lseek(m_fd, 0, SEEK_SET) != 0) {
+        return;
+    }
+
+    // procfs files report a size of 0 so they have to be read until EOF
+    QByteArray contents;
+    char buffer[16384];
+    ssize_t bytesRead;
+    while ((bytesRead = read(m_fd, buffer, sizeof(buffer))) > 0) {
+        contents.append(buffer, static_cast<int>(bytesRead));
+    }
+
+    QHash<QString, QString> sysfsDevices;
+    bool sysfsLoaded = false;
+    QHash<QString, QString> deviceUuids;
+
+    const QList<QByteArray> lines = contents.split('\n');
+    for (const QByteArray &line : lines) {
+        // The fields before the separator vary in number, the ones after it are fstype, source and super options
+        const int separator = line.indexOf(" - ");
+        if (separator == -1) {
+            continue;
+        }
+        const QList<QByteArray> mountFields = line.left(separator).split(' ');
+        const QList<QByteArray> fsFields = line.mid(separator + 3).split(' ');
+        if (mountFields.count() < 6 || fsFields.count() < 3 || fsFields.at(0) != "btrfs") {
+            continue;
+        }
+
+        MountEntry entry;
+        entry.target = unescapeField(mountFields.at(4));
+        entry.source = unescapeField(fsFields.at(1));
+
+        const QList<QByteArray> options = fsFields.at(2).split(',');
+        for (const QByteArray &option : options) {
+            if (option.startsWith("subvolid=")) {
+                entry.subvolid = option.mid(9).toULongLong();
+            } else if (option.startsWith("subvol=")) {
+                entry.subvol = unescapeField(option.mid(7));
+            }
+        }
+
+        // The device number is shared by every mount of a filesystem so the UUID only needs to be found once per parse.
+        // It isn't kept between parses since the kernel hands the anonymous device numbers out again after an unmount.
+        const QString device = QString::fromLatin1(mountFields.at(2));
+        if (!deviceUuids.contains(device)) {
+            if (!sysfsLoaded) {
+                sysfsDevices = readSysfsDevices();
+                sysfsLoaded = true;
+            }
+            QString uuid = sysfsDevices.value(QFileInfo(QFileInfo(entry.source).canonicalFilePath()).fileName());
+            if (uuid.isEmpty()) {
+                uuid = readUuidIoctl(entry.target);
+            }
+            deviceUuids.insert(device, uuid);
+        }
+        entry.uuid = deviceUuids.value(device);
+
+        const int position = m_entries.count();
+        m_entries.append(entry);
+        m_byUuid[entry.uuid].append(position);
+        m_bySubvolid[entry.subvolid].append(position);
+        // When a target is mounted over, the last mount is the visible one
+        m_byTarget.insert(entry.target, position);
+    }
+}
+
+void MountTable::refresh()
+{
+    // The kernel flags POLLPRI on the mountinfo descriptor whenever the mount namespace changes
+    if (m_fd >= 0) {
+        struct pollfd pfd = {m_fd, POLLPRI, 0};
+        if (poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLPRI | POLLERR))) {
+            m_isStale = true;
+        }
+    }
+
+    if (m_isStale) {
+        parse();
+        m_isStale = false;
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef MOUNTTABLE_H
+#define MOUNTTABLE_H
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// A single btrfs mount parsed from /proc/self/mountinfo
+struct MountEntry {
+    QString uuid;
+    QString target;
+    QString source;
+    QString subvol;
+    uint64_t subvolid = 0;
+};
+
+/**
+ * @brief The MountTable class is a singleton cache of the btrfs mounts on the system
+ *
+ * The table is parsed from /proc/self/mountinfo and indexed by filesystem UUID, subvolid and target.  The mountinfo
+ * file descriptor is polled for POLLPRI before every lookup so the table is only reparsed after the kernel reports a
+ * change to the mounts.
+ */
+class MountTable {
+  public:
+    /**
+     * @brief Gets a reference to the MountTable object
+     */
+    static MountTable &instance();
+
+    /**
+     * @brief Finds the first mountpoint of a btrfs filesystem
+     * @param uuid - The UUID of the filesystem to find the mountpoint for
+     * @return The absolute path to the mountpoint or a default constructed QString if it isn't mounted
+     */
+    QString findAnyMountpoint(const QString &uuid);
+
+    /**
+     * @brief Finds the first mountpoint of a specific subvolume
+     * @param uuid - The UUID of the filesystem containing the subvolume
+     * @param subvolid - The ID of the subvolume
+     * @return The absolute path to the mountpoint or a default constructed QString if it isn't mounted
+     */
+    QString findMountpoint(const QString &uuid, uint64_t subvolid);
+
+    /**
+     * @brief Finds the UUID of the btrfs filesystem mounted at @p target
+     * @param target - The absolute path of a mountpoint
+     * @return The UUID or a default constructed QString if no btrfs filesystem is mounted at @p target
+     */
+    QString findUuid(const QString &target);
+
+    /**
+     * @brief Returns true if at least one btrfs filesystem is mounted
+     */
+    bool hasBtrfs();
+
+    /**
+     * @brief Forces the table to be reparsed on the next lookup
+     */
+    void invalidate();
+
+    /**
+     * @brief Returns true if the subvolume @p subvolid of filesystem @p uuid is mounted anywhere
+     */
+    bool isMounted(const QString &uuid, uint64_t subvolid) { return !findMountpoint(uuid, subvolid).isEmpty(); }
+
+    /**
+     * @brief Returns all the btrfs mountpoints in the order they appear in the mount table
+     */
+    QStringList mountpoints();
+
+  private:
+    MountTable();
+    ~MountTable();
+    // Delete the copy constructor and the assignment operator
+    MountTable(MountTable const &) = delete;
+    void operator=(MountTable const &) = delete;
+
+    /**
+     * @brief Parses /proc/self/mountinfo and rebuilds the indexes
+     *
+     * Must be called with m_mutex held
+     */
+    void parse();
+
+    /**
+     * @brief Reparses /proc/self/mountinfo if the kernel has signaled a change since the last parse
+     *
+     * Must be called with m_mutex held
+     */
+    void refresh();
+
+    // The file descriptor for /proc/self/mountinfo, kept open so it can be polled for changes
+    int m_fd = -1;
+    bool m_isStale = true;
+    QMutex m_mutex;
+
+    QVector<MountEntry> m_entries;
+    // The indexes hold positions in m_entries in mount table order
+    QHash<QString, QVector<int>> m_byUuid;
+    QHash<uint64_t, QVector<int>> m_bySubvolid;
+    QHash<QString, int> m_byTarget;
+};
+
+#endif // MOUNTTABLE_H
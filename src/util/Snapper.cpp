@@ -1,23 +1,264 @@
 #include "util/Snapper.h"
 #include "CsvParser.h"
+#include "util/MetadataCache.h"
 #include "util/Settings.h"
 #include "util/System.h"
-
+#include "util/Trace.h"
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
 #include <unistd.h>
 
 #include <QDebug>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QRegularExpression>
+#include <QTextStream>
 #include <QXmlStreamReader>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <optional>
 
+constexpr const char *CONFIG_DIR = "/etc/snapper/configs";
 constexpr const char *DEFAULT_SNAP_PATH = "/.snapshots";
 constexpr const char *DEFAULT_SNAP_SUBVOL = ".snapshots";
 constexpr const char *ROOT_PATH = "/";
 
+// The files distributions use to hold SNAPPER_CONFIGS, the list of configs that are in use
+const QStringList SYSCONFIG_FILES = {"/etc/conf.d/snapper", "/etc/sysconfig/snapper", "/etc/default/snapper"};
+
+// The events that mean the snapshots or configs in a watched directory have changed
+constexpr uint32_t WATCH_EVENTS = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF;
+
+namespace {
+
+// The most copy_file_range() is asked to copy at once when a file can't be cloned
+constexpr size_t COPY_CHUNK_SIZE = 64 * 1024 * 1024;
+
+// The buffer used when copy_file_range() isn't supported either
+constexpr size_t READ_BUFFER_SIZE = 1024 * 1024;
+
+// The inode flags carried over to a restored file, btrfs won't clone between a NOCOW file and a checksummed one
+constexpr int COPIED_INODE_FLAGS = FS_NOCOW_FL | FS_COMPR_FL;
+
+/**
+ * @brief Copies the NOCOW and compression flags of @p source to the empty file @p dest
+ *
+ * NOCOW can only be changed while a file is empty so this has to happen before any data is copied
+ */
+void copyInodeFlags(int source, int dest)
+{
+    int sourceFlags = 0;
+    int destFlags = 0;
+    if (ioctl(source, FS_IOC_GETFLAGS, &sourceFlags) != 0 || ioctl(dest, FS_IOC_GETFLAGS, &destFlags) != 0) {
+        return;
+    }
+
+    const int flags = (destFlags & ~COPIED_INODE_FLAGS) | (sourceFlags & COPIED_INODE_FLAGS);
+    if (flags != destFlags && ioctl(dest, FS_IOC_SETFLAGS, &flags) != 0) {
+        qWarning() << "Failed to restore the inode flags:" << strerror(errno);
+    }
+}
+
+/**
+ * @brief Copies the data of @p source to the empty file @p dest
+ *
+ * The NOCOW and compression flags of @p source are set on @p dest first.  The extents are then cloned when both files
+ * are on the same btrfs filesystem so nothing is copied at all.  Otherwise the kernel copies the data with
+ * copy_file_range() and only if that isn't supported is it read and written here.
+ * @return The way the data was copied or an empty string if it failed
+ */
+QString copyFileData(int source, int dest)
+{
+    copyInodeFlags(source, dest);
+    if (ioctl(dest, FICLONE, source) == 0) {
+        return QStringLiteral("reflink");
+    }
+
+    bool isFirstChunk = true;
+    while (true) {
+        const ssize_t copied = copy_file_range(source, nullptr, dest, nullptr, COPY_CHUNK_SIZE, 0);
+        if (copied == 0) {
+            return QStringLiteral("copy_file_range");
+        }
+        if (copied < 0) {
+            if (isFirstChunk && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL)) {
+                break;
+            }
+            return QString();
+        }
+        isFirstChunk = false;
+    }
+
+    QByteArray buffer(static_cast<int>(READ_BUFFER_SIZE), Qt::Uninitialized);
+    while (true) {
+        const ssize_t bytesRead = read(source, buffer.data(), READ_BUFFER_SIZE);
+        if (bytesRead == 0) {
+            return QStringLiteral("read/write");
+        }
+        if (bytesRead < 0) {
+            return QString();
+        }
+        for (ssize_t written = 0; written < bytesRead;) {
+            const ssize_t result = write(dest, buffer.constData() + written, static_cast<size_t>(bytesRead - written));
+            if (result < 0) {
+                return QString();
+            }
+            written += result;
+        }
+    }
+}
+
+/**
+ * @brief Copies the extended attributes of @p source to @p dest, which includes the ACLs
+ * @return False if any attribute couldn't be copied
+ */
+bool copyXattrs(int source, int dest)
+{
+    const ssize_t listSize = flistxattr(source, nullptr, 0);
+    if (listSize <= 0) {
+        return listSize == 0 || errno == ENOTSUP;
+    }
+
+    QByteArray names(static_cast<int>(listSize), Qt::Uninitialized);
+    if (flistxattr(source, names.data(), static_cast<size_t>(names.size())) != listSize) {
+        return false;
+    }
+
+    bool isCopied = true;
+    for (const QByteArray &name : names.split('\0')) {
+        if (name.isEmpty()) {
+            continue;
+        }
+
+        const ssize_t valueSize = fgetxattr(source, name.constData(), nullptr, 0);
+        QByteArray value(static_cast<int>(std::max<ssize_t>(valueSize, 0)), Qt::Uninitialized);
+        if (valueSize < 0 || fgetxattr(source, name.constData(), value.data(), static_cast<size_t>(value.size())) != valueSize ||
+            fsetxattr(dest, name.constData(), value.constData(), static_cast<size_t>(value.size()), 0) != 0) {
+            qWarning() << "Failed to restore the extended attribute" << name << ":" << strerror(errno);
+            isCopied = false;
+        }
+    }
+
+    return isCopied;
+}
+
+// The info.xml of a snapper snapshot along with what identifies it in the metadata cache
+struct SnapperMetaFile {
+    QString filename;
+    QString uuid;
+    uint64_t subvolid = 0;
+    QDateTime createdAt;
+};
+
+/**
+ * @brief Reads the metadata of a snapshot from the metadata cache, only parsing the info.xml when it isn't cached
+ * @param file - The info.xml to read
+ * @return A SnapperSnapshot where number is 0 if it couldn't be read
+ */
+SnapperSnapshot readCachedSnapperMeta(const SnapperMetaFile &file)
+{
+    const QFileInfo info(file.filename);
+    const qint64 modified = info.exists() ? info.lastModified().toMSecsSinceEpoch() : -1;
+
+    MetadataCache &cache = MetadataCache::instance();
+    const std::optional<SnapperSnapshot> cached = cache.snapperSnapshot(file.uuid, file.subvolid, file.createdAt, modified);
+    if (cached) {
+        return *cached;
+    }
+
+    const SnapperSnapshot snap = Snapper::readSnapperMeta(file.filename);
+    if (snap.number != 0) {
+        cache.setSnapperSnapshot(file.uuid, file.subvolid, file.createdAt, modified, snap);
+    }
+    return snap;
+}
+
+/**
+ * @brief Reads the KEY="value" assignments from a shell style file like the snapper configs
+ * @param filename - The absolute path to the file to read
+ * @return A map of the keys and their unquoted values, or std::nullopt if the file couldn't be read
+ */
+std::optional<QMap<QString, QString>> readShellVariables(const QString &filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return std::nullopt;
+    }
+
+    QMap<QString, QString> variables;
+    QTextStream stream(&file);
+    while (!stream.atEnd()) {
+        const QString line = stream.readLine().trimmed();
+        const int separator = line.indexOf('=');
+        if (line.startsWith('#') || separator <= 0) {
+            continue;
+        }
+
+        QString value = line.mid(separator + 1).trimmed();
+        if (value.length() >= 2 && (value.startsWith('"') || value.startsWith('\'')) && value.endsWith(value.at(0))) {
+            value = value.mid(1, value.length() - 2);
+        }
+        variables.insert(line.left(separator).trimmed(), value.replace("\\\"", "\""));
+    }
+
+    return variables;
+}
+
+/**
+ * @brief Finds the names of the snapper configs in use without running snapper
+ * @return The names of the configs, or std::nullopt if the config directory can't be read
+ */
+std::optional<QStringList> readConfigNames()
+{
+    const QDir configDir(CONFIG_DIR);
+    if (!configDir.exists()) {
+        return std::nullopt;
+    }
+
+    const QStringList files = configDir.entryList(QDir::Files | QDir::NoDotAndDotDot, QDir::Name);
+
+    // Snapper only uses the configs listed in SNAPPER_CONFIGS when one of the sysconfig files exists
+    for (const QString &filename : SYSCONFIG_FILES) {
+        const std::optional<QMap<QString, QString>> variables = readShellVariables(filename);
+        if (variables && variables->contains("SNAPPER_CONFIGS")) {
+            QStringList names;
+            const QStringList listed = variables->value("SNAPPER_CONFIGS").split(' ', Qt::SkipEmptyParts);
+            for (const QString &name : listed) {
+                if (files.contains(name)) {
+                    names.append(name);
+                }
+            }
+            return names;
+        }
+    }
+
+    return files;
+}
+
+} // namespace
+
 Snapper::Snapper(Btrfs *btrfs, QString snapperCommand, QObject *parent) : QObject{parent}, m_btrfs(btrfs), m_snapperCommand(snapperCommand)
 {
-    load();
+    m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotifyFd < 0) {
+        qWarning() << "Failed to initialize inotify, the snapper metadata will be read on every load";
+    }
+}
+
+Snapper::~Snapper()
+{
+    if (m_inotifyFd >= 0) {
+        close(m_inotifyFd);
+    }
 }
 
 Snapper::Config Snapper::config(const QString &name) { return m_configs.value(name); }
@@ -88,6 +329,28 @@ QString Snapper::findTargetPath(const QString &snapshotPath, const QString &file
     return QDir::cleanPath(mountpoint + QDir::separator() + subvolResultTarget.name + QDir::separator() + relpath);
 }
 
+QVector<SnapperSubvolume> Snapper::siblingSnapshots(const QString &snapshotPath, const QString &uuid)
+{
+    const SubvolResult subvolResultSnapshot = findSnapshotSubvolume(snapshotPath);
+    const QString mountpoint = m_btrfs->mountRoot(uuid);
+    if (!subvolResultSnapshot.success || mountpoint.isEmpty()) {
+        return QVector<SnapperSubvolume>();
+    }
+
+    const QString relSnapshotSubvol = QDir(mountpoint).relativeFilePath(subvolResultSnapshot.name);
+
+    QVector<SnapperSubvolume> siblings;
+    for (const QVector<SnapperSubvolume> &subvols : qAsConst(m_subvols)) {
+        for (const SnapperSubvolume &subvol : subvols) {
+            if (subvol.uuid == uuid && findSnapshotSubvolume(subvol.subvol).name == relSnapshotSubvol) {
+                siblings.append(subvol);
+            }
+        }
+    }
+
+    return siblings;
+}
+
 SubvolResult Snapper::findTargetSubvol(const QString &snapshotSubvol, const QString &uuid) const
 {
     if (m_subvolMap.value(snapshotSubvol).uuid == uuid) {
@@ -99,112 +362,86 @@ SubvolResult Snapper::findTargetSubvol(const QString &snapshotSubvol, const QStr
 
 void Snapper::load()
 {
+    TraceSpan span("Snapper::load", "snapper");
+
     // Load the subvol map from config
     loadSubvolMap();
 
-    // Load the list of valid configs
-    m_configs.clear();
+    readInotifyEvents();
     m_snapshots.clear();
-    const SnapperResult result = runSnapper("list-configs --columns config");
-
-    if (result.exitCode != 0 || result.outputList.isEmpty()) {
-        return;
-    }
-
-    for (const QString &line : qAsConst(result.outputList)) {
-        // for each config, add to the map and add it's snapshots to the vector
-        SnapperResult listResult;
-        QString name = line.trimmed();
 
-        loadConfig(name);
+    // Load the list of valid configs, the configs are only read again after something changed in the config directory
+    if (m_isConfigListStale) {
+        m_configs.clear();
 
-        // The root needs special handling because we may be booted off a snapshot
-        if (name == "root") {
-            listResult = runSnapper("list --columns number,date,description,type,cleanup");
-
-            if (listResult.exitCode != 0) {
-                continue;
+        QStringList names;
+        const std::optional<QStringList> configNames = readConfigNames();
+        if (configNames) {
+            names = *configNames;
+            // Watch before reading the configs so a change made while they are read isn't missed
+            m_isConfigListStale = !addWatch(CONFIG_DIR, QString());
+        } else {
+            const SnapperResult result = runSnapper("list-configs --columns config");
+            if (result.exitCode != 0) {
+                return;
             }
-
-            if (listResult.outputList.isEmpty()) {
-                // This means that either there are no snapshots or the root is mounted on non-btrfs filesystem like an overlayfs
-                // Let's check the latter case first
-                if (!m_btrfs->subvolumeName(DEFAULT_SNAP_SUBVOL).success) {
-                    // This probably means there are just no snapshots or we are using a nested subvol in another place
-                    continue;
-                }
-
-                // Now we need to find out where the snapshots are actually stored
-                const uint64_t parentId = m_btrfs->subvolParent(DEFAULT_SNAP_SUBVOL);
-
-                // It shouldn't be possible for the parent to not exist but we check anyway
-                if (parentId == 0) {
-                    continue;
-                }
-
-                const QString uuid = System::runCmd("findmnt", {"-no", "uuid", DEFAULT_SNAP_PATH}, false).output;
-
-                // Make sure the root of the partition is mounted
-                QString mountpoint = m_btrfs->mountRoot(uuid);
-                if (mountpoint.isEmpty()) {
-                    continue;
+            for (const QString &line : qAsConst(result.outputList)) {
+                if (!line.trimmed().isEmpty()) {
+                    names.append(line.trimmed());
                 }
-
-                const QString parentName = m_btrfs->subvolumeName(uuid, parentId).name;
-
-                listResult = runSnapper("--no-dbus -r " + QDir::cleanPath(mountpoint + QDir::separator() + parentName) +
-                                        " list --columns number,date,description,type");
-                if (listResult.exitCode != 0 || listResult.outputList.isEmpty()) {
-                    // If this is still empty, give up
-                    continue;
-                }
-            }
-        } else {
-            listResult = runSnapper("list --columns number,date,description,type,cleanup", name);
-            if (listResult.exitCode != 0 || listResult.outputList.isEmpty()) {
-                continue;
             }
         }
 
-        for (const QString &snap : qAsConst(listResult.outputList)) {
-            // Parse `complex` CSV where ',' and '"' in the description are possible
-            QStringList cols = parseCsvLine(snap);
-
-            const uint number = cols.at(0).toUInt();
-            // Snapshot 0 is not a real snapshot
-            if (number == 0) {
-                continue;
-            }
+        for (const QString &name : qAsConst(names)) {
+            loadConfig(name);
+        }
+    }
 
-            m_snapshots[name].append({number, QDateTime::fromString(cols.at(1), Qt::ISODate), cols.at(2), cols.at(3), cols.at(4)});
+    // Add the snapshots of each config to the map, only asking snapper when the snapshot directory can't be found
+    const QStringList names = m_configs.keys();
+    for (const QString &name : names) {
+        if (!readSnapshots(name)) {
+            loadSnapperSnapshots(name);
         }
     }
+
     loadSubvols();
 }
 
 void Snapper::loadConfig(const QString &name)
 {
+    TraceSpan span("Snapper::loadConfig", "snapper");
+    span.setArg("config", name);
+
     // If the config is already loaded, remove the old data
     if (m_configs.contains(name)) {
         m_configs.remove(name);
     }
 
-    // Call Snapper to get the config data
-    const SnapperResult result = runSnapper("get-config", name);
+    Config config;
+
+    const std::optional<QMap<QString, QString>> variables = readShellVariables(QDir(CONFIG_DIR).filePath(name));
+    if (variables) {
+        for (auto it = variables->cbegin(); it != variables->cend(); ++it) {
+            config.insert(it.key(), it.value());
+        }
+    } else {
+        // The config file couldn't be read so call Snapper to get the config data
+        const SnapperResult result = runSnapper("get-config", name);
 
-    if (result.exitCode != 0) {
-        return;
-    }
+        if (result.exitCode != 0) {
+            return;
+        }
 
-    // Iterate over the data adding the name/value pairs to the map
-    Config config;
-    for (const QString &line : result.outputList) {
-        if (line.trimmed().isEmpty()) {
-            continue;
+        // Iterate over the data adding the name/value pairs to the map
+        for (const QString &line : result.outputList) {
+            if (line.trimmed().isEmpty()) {
+                continue;
+            }
+            QString key = line.split(',').at(0).trimmed();
+            QString value = line.split(',').at(1).trimmed();
+            config.insert(key, value);
         }
-        QString key = line.split(',').at(0).trimmed();
-        QString value = line.split(',').at(1).trimmed();
-        config.insert(key, value);
     }
 
     // Add the map to m_configs
@@ -213,6 +450,75 @@ void Snapper::loadConfig(const QString &name)
     }
 }
 
+void Snapper::loadSnapperSnapshots(const QString &name)
+{
+    TraceSpan span("Snapper::loadSnapperSnapshots", "snapper");
+    span.setArg("config", name);
+
+    SnapperResult listResult;
+
+    // The root needs special handling because we may be booted off a snapshot
+    if (name == "root") {
+        listResult = runSnapper("list --columns number,date,description,type,cleanup");
+
+        if (listResult.exitCode != 0) {
+            return;
+        }
+
+        if (listResult.outputList.isEmpty()) {
+            // This means that either there are no snapshots or the root is mounted on non-btrfs filesystem like an overlayfs
+            // Let's check the latter case first
+            if (!m_btrfs->subvolumeName(DEFAULT_SNAP_SUBVOL).success) {
+                // This probably means there are just no snapshots or we are using a nested subvol in another place
+                return;
+            }
+
+            // Now we need to find out where the snapshots are actually stored
+            const uint64_t parentId = m_btrfs->subvolParent(DEFAULT_SNAP_SUBVOL);
+
+            // It shouldn't be possible for the parent to not exist but we check anyway
+            if (parentId == 0) {
+                return;
+            }
+
+            const QString uuid = System::findUuid(DEFAULT_SNAP_PATH);
+
+            // Make sure the root of the partition is mounted
+            QString mountpoint = m_btrfs->mountRoot(uuid);
+            if (mountpoint.isEmpty()) {
+                return;
+            }
+
+            const QString parentName = m_btrfs->subvolumeName(uuid, parentId).name;
+
+            listResult = runSnapper("--no-dbus -r " + QDir::cleanPath(mountpoint + QDir::separator() + parentName) +
+                                    " list --columns number,date,description,type");
+            if (listResult.exitCode != 0 || listResult.outputList.isEmpty()) {
+                // If this is still empty, give up
+                return;
+            }
+        }
+    } else {
+        listResult = runSnapper("list --columns number,date,description,type,cleanup", name);
+        if (listResult.exitCode != 0 || listResult.outputList.isEmpty()) {
+            return;
+        }
+    }
+
+    for (const QString &snap : qAsConst(listResult.outputList)) {
+        // Parse `complex` CSV where ',' and '"' in the description are possible
+        QStringList cols = parseCsvLine(snap);
+
+        const uint number = cols.at(0).toUInt();
+        // Snapshot 0 is not a real snapshot
+        if (number == 0) {
+            continue;
+        }
+
+        m_snapshots[name].append({number, QDateTime::fromString(cols.at(1), Qt::ISODate), cols.at(2), cols.at(3), cols.at(4)});
+    }
+}
+
 void Snapper::loadSubvolMap()
 {
     // Load the subvolume map from settings if present
@@ -237,14 +543,20 @@ void Snapper::loadSubvolMap()
     }
 }
 
-void Snapper::loadSubvols()
+void Snapper::loadSubvols() { loadSubvols(Btrfs::listFilesystems()); }
+
+void Snapper::loadSubvols(const QStringList &uuids)
 {
+    TraceSpan span("Snapper::loadSubvols", "snapper");
+
     // Clear the existing info
     m_subvols.clear();
 
-    // Get a list of the btrfs filesystems and loop over them
-    const QStringList btrfsFilesystems = Btrfs::listFilesystems();
-    for (const QString &uuid : btrfsFilesystems) {
+    // Collect the snapper snapshots first so the metadata of all of them can be read in parallel
+    QVector<SnapperSubvolume> snapperSubvols;
+    QVector<SnapperMetaFile> metaFiles;
+
+    for (const QString &uuid : uuids) {
         // We need to ensure the root is mounted and get the mountpoint
         QString mountpoint = m_btrfs->mountRoot(uuid);
         if (mountpoint.isEmpty()) {
@@ -266,50 +578,69 @@ void Snapper::loadSubvols()
             snapperSubvol.subvolid = subvol.id;
             snapperSubvol.subvol = subvol.subvolName;
 
-            // It is a snapshot so now we parse it and read the snapper XML
+            // It is a snapshot so the snapper XML sits next to it
             const QString end = "snapshot";
-            QString filename = snapperSubvol.subvol.left(snapperSubvol.subvol.length() - end.length()) + "info.xml";
+            const QString filename = snapperSubvol.subvol.left(snapperSubvol.subvol.length() - end.length()) + "info.xml";
 
-            filename = QDir::cleanPath(mountpoint + QDir::separator() + filename);
+            snapperSubvols.append(snapperSubvol);
+            metaFiles.append({QDir::cleanPath(mountpoint + QDir::separator() + filename), uuid, subvol.id, subvol.createdAt});
+        }
+    }
 
-            SnapperSnapshot snap = readSnapperMeta(filename);
+    // Parsing the XML is the slow part with thousands of snapshots so spread it over the thread pool, the results come
+    // back in the same order as the files.  Only the files missing from the metadata cache are actually parsed.
+    QElapsedTimer timer;
+    timer.start();
+    const QVector<SnapperSnapshot> snaps = QtConcurrent::blockingMapped<QVector<SnapperSnapshot>>(metaFiles, readCachedSnapperMeta);
+    const qint64 elapsed = std::max<qint64>(timer.elapsed(), 1);
+    span.setArg("files", metaFiles.size());
+    qDebug() << "Read" << metaFiles.size() << "snapper metadata files in" << elapsed << "ms,"
+             << qRound64(static_cast<double>(metaFiles.size()) * 1000 / static_cast<double>(elapsed)) << "files/s";
+    MetadataCache::instance().save();
+
+    for (int i = 0; i < snapperSubvols.size(); i++) {
+        SnapperSubvolume &snapperSubvol = snapperSubvols[i];
+        const SnapperSnapshot &snap = snaps.at(i);
+
+        if (snap.number == 0) {
+            continue;
+        }
 
-            if (snap.number == 0) {
-                continue;
-            }
+        snapperSubvol.desc = snap.desc;
+        snapperSubvol.time = snap.time;
+        snapperSubvol.snapshotNum = snap.number;
+        snapperSubvol.type = snap.type;
 
-            snapperSubvol.desc = snap.desc;
-            snapperSubvol.time = snap.time;
-            snapperSubvol.snapshotNum = snap.number;
-            snapperSubvol.type = snap.type;
+        const QString &uuid = snapperSubvol.uuid;
+        const SubvolResult subvolResultSnapshot = findSnapshotSubvolume(snapperSubvol.subvol);
+        if (!subvolResultSnapshot.success) {
+            continue;
+        }
 
-            const SubvolResult subvolResultSnapshot = findSnapshotSubvolume(snapperSubvol.subvol);
-            if (!subvolResultSnapshot.success) {
+        // Check the map for the target subvolume
+        const SubvolResult subvolResultTarget = findTargetSubvol(subvolResultSnapshot.name, uuid);
+        QString targetSubvol = subvolResultTarget.name;
+        // If it failed, it may mean the the map isn't loaded yet for the nested subvolumes
+        if (!subvolResultTarget.success) {
+            if (subvolResultSnapshot.name.endsWith(DEFAULT_SNAP_PATH) || subvolResultSnapshot.name == DEFAULT_SNAP_SUBVOL) {
+                const uint64_t targetSubvolId = m_btrfs->subvolId(uuid, subvolResultSnapshot.name);
+                const uint64_t parentId = m_btrfs->subvolParent(uuid, targetSubvolId);
+                targetSubvol = m_btrfs->subvolumeName(uuid, parentId).name;
+            } else {
                 continue;
             }
-
-            // Check the map for the target subvolume
-            const SubvolResult subvolResultTarget = findTargetSubvol(subvolResultSnapshot.name, uuid);
-            QString targetSubvol = subvolResultTarget.name;
-            // If it failed, it may mean the the map isn't loaded yet for the nested subvolumes
-            if (!subvolResultTarget.success) {
-                if (subvolResultSnapshot.name.endsWith(DEFAULT_SNAP_PATH) || subvolResultSnapshot.name == DEFAULT_SNAP_SUBVOL) {
-                    const uint64_t targetSubvolId = m_btrfs->subvolId(uuid, subvolResultSnapshot.name);
-                    const uint64_t parentId = m_btrfs->subvolParent(uuid, targetSubvolId);
-                    targetSubvol = m_btrfs->subvolumeName(uuid, parentId).name;
-                } else {
-                    continue;
-                }
-            }
-
-            m_subvols[targetSubvol].append(snapperSubvol);
         }
+
+        m_subvols[targetSubvol].append(snapperSubvol);
     }
     createSubvolMap();
 }
 
 SnapperSnapshot Snapper::readSnapperMeta(const QString &filename)
 {
+    TraceSpan span("Snapper::readSnapperMeta", "snapper");
+    span.setArg("filename", filename);
+
     SnapperSnapshot snap;
     QFile metaFile(filename);
 
@@ -344,27 +675,78 @@ SnapperSnapshot Snapper::readSnapperMeta(const QString &filename)
 
 bool Snapper::restoreFile(const QString &sourcePath, const QString &destPath) const
 {
-
-    // QFile won't overwrite an existing file so we need to remove it first
-    if (QFile::exists(destPath)) {
-        QFile::remove(destPath);
+    TraceSpan span("Snapper::restoreFile", "snapper");
+    span.setArg("file", destPath);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const int source = open(sourcePath.toLocal8Bit(), O_RDONLY | O_CLOEXEC);
+    struct stat sourceStat = {};
+    if (source < 0 || fstat(source, &sourceStat) != 0) {
+        qWarning() << "Failed to open" << sourcePath << ":" << strerror(errno);
+        if (source >= 0) {
+            close(source);
+        }
+        return false;
     }
-    if (!QFile::copy(sourcePath, destPath)) {
+
+    // The file is restored next to the destination and renamed over it so a failed restore leaves the old file alone
+    QByteArray tempPath = (destPath + ".XXXXXX").toLocal8Bit();
+    const int dest = mkostemp(tempPath.data(), O_CLOEXEC);
+    if (dest < 0) {
+        qWarning() << "Failed to create a file next to" << destPath << ":" << strerror(errno);
+        close(source);
         return false;
     }
 
-    // Now we need to restore the permissions or it will be owned by root
-    QFileInfo qfi(sourcePath);
-    if (chown(destPath.toUtf8(), qfi.ownerId(), qfi.groupId()) != 0) {
-        qWarning() << tr("Failed to reset ownership of restored file") << Qt::endl;
+    const QString method = copyFileData(source, dest);
+    bool isRestored = !method.isEmpty();
+    if (!isRestored) {
+        qWarning() << "Failed to copy" << sourcePath << ":" << strerror(errno);
+    }
+
+    // The owner has to be set before the mode since changing it clears the setuid bits, and both before the extended
+    // attributes since the ACLs adjust the mode and changing the owner drops file capabilities
+    if (isRestored) {
+        if (fchown(dest, sourceStat.st_uid, sourceStat.st_gid) != 0) {
+            qWarning() << tr("Failed to reset ownership of restored file") << Qt::endl;
+        }
+        if (fchmod(dest, sourceStat.st_mode & 07777) != 0) {
+            qWarning() << "Failed to reset the permissions of" << destPath << ":" << strerror(errno);
+        }
+        copyXattrs(source, dest);
+
+        const struct timespec times[2] = {sourceStat.st_atim, sourceStat.st_mtim};
+        if (futimens(dest, times) != 0) {
+            qWarning() << "Failed to reset the timestamps of" << destPath << ":" << strerror(errno);
+        }
+
+        isRestored = fsync(dest) == 0 && rename(tempPath.constData(), destPath.toLocal8Bit()) == 0;
+        if (!isRestored) {
+            qWarning() << "Failed to replace" << destPath << ":" << strerror(errno);
+        }
+    }
+
+    close(dest);
+    close(source);
+    if (!isRestored) {
+        unlink(tempPath.constData());
+        return false;
     }
-    QFile::setPermissions(destPath, QFile::permissions(sourcePath));
+
+    const qint64 elapsed = std::max<qint64>(timer.elapsed(), 1);
+    span.setArg("method", method);
+    span.setArg("bytes", static_cast<qint64>(sourceStat.st_size));
+    qDebug() << "Restored" << destPath << "with" << method << ":" << sourceStat.st_size << "bytes in" << elapsed << "ms,"
+             << qRound64(static_cast<double>(sourceStat.st_size) / 1024 / 1024 * 1000 / static_cast<double>(elapsed)) << "MiB/s";
 
     return true;
 }
 
-SnapperResult Snapper::setCleanupAlgorithm(const QString &config, const uint number, const QString &cleanupAlg) const
+SnapperResult Snapper::setCleanupAlgorithm(const QString &config, const uint number, const QString &cleanupAlg)
 {
+    invalidateSnapshots(config);
     return runSnapper("modify -c \"" + cleanupAlg + "\" " + QString::number(number), config);
 }
 
@@ -419,6 +801,133 @@ QVector<SnapperSubvolume> Snapper::subvols(const QString &config)
  *
  */
 
+bool Snapper::addWatch(const QString &path, const QString &config)
+{
+    if (m_inotifyFd < 0) {
+        return false;
+    }
+
+    const int wd = inotify_add_watch(m_inotifyFd, path.toLocal8Bit().constData(), WATCH_EVENTS);
+    if (wd < 0) {
+        qWarning() << "Failed to watch" << path << "for changes:" << strerror(errno);
+        return false;
+    }
+
+    m_watches.insert(wd, config);
+    return true;
+}
+
+void Snapper::invalidateSnapshots(const QString &name) { m_snapshotCache[name].isStale = true; }
+
+void Snapper::readInotifyEvents()
+{
+    if (m_inotifyFd < 0) {
+        m_isConfigListStale = true;
+        return;
+    }
+
+    alignas(inotify_event) char buffer[4096];
+    ssize_t length;
+    while ((length = read(m_inotifyFd, buffer, sizeof(buffer))) > 0) {
+        for (const char *pos = buffer; pos < buffer + length;) {
+            const auto *event = reinterpret_cast<const inotify_event *>(pos);
+            pos += sizeof(inotify_event) + event->len;
+
+            // Some events were dropped so there is no telling what changed
+            if (event->mask & IN_Q_OVERFLOW) {
+                m_isConfigListStale = true;
+                for (SnapshotCache &cache : m_snapshotCache) {
+                    cache.isStale = true;
+                }
+                continue;
+            }
+
+            const auto it = m_watches.constFind(event->wd);
+            if (it == m_watches.cend()) {
+                continue;
+            }
+
+            if (it->isNull()) {
+                m_isConfigListStale = true;
+            } else {
+                invalidateSnapshots(*it);
+            }
+
+            // The directory is gone or was unmounted so it needs to be watched again when it is read
+            if (event->mask & IN_IGNORED) {
+                m_watches.erase(it);
+            }
+        }
+    }
+}
+
+bool Snapper::readSnapshots(const QString &name)
+{
+    const QString subvolume = m_configs.value(name).subvolume();
+    if (subvolume.isEmpty()) {
+        return false;
+    }
+
+    const QString path = QDir::cleanPath(subvolume + QDir::separator() + DEFAULT_SNAP_SUBVOL);
+    SnapshotCache &cache = m_snapshotCache[name];
+
+    const QDir snapshotDir(path);
+    QVector<uint> numbers;
+    if (cache.isStale || cache.path != path) {
+        // This happens when the root is mounted on something like an overlayfs, snapper knows where to look in that case
+        if (!snapshotDir.exists()) {
+            return false;
+        }
+
+        // Watch before listing the directory so a snapshot created in between isn't missed
+        cache.isStale = !addWatch(path, name);
+        cache.path = path;
+
+        const QStringList entries = snapshotDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+        for (const QString &entry : entries) {
+            bool ok = false;
+            const uint number = entry.toUInt(&ok);
+            // Snapshot 0 is not a real snapshot
+            if (ok && number != 0) {
+                numbers.append(number);
+            }
+        }
+    } else {
+        // The watch only sees snapshots being added or removed, snapper replaces info.xml inside the numbered directory
+        // when a snapshot is modified so the cached snapshots still have their modification times checked
+        numbers = cache.snapshots.keys().toVector();
+    }
+
+    QMap<uint, QPair<qint64, SnapperSnapshot>> snapshots;
+    for (const uint number : qAsConst(numbers)) {
+        // Only parse the info.xml files which changed since they were last read
+        const QFileInfo info(snapshotDir.filePath(QString::number(number) + "/info.xml"));
+        const qint64 modified = info.exists() ? info.lastModified().toMSecsSinceEpoch() : -1;
+        const auto it = cache.snapshots.constFind(number);
+        if (it != cache.snapshots.cend() && modified >= 0 && it->first == modified) {
+            snapshots.insert(number, *it);
+            continue;
+        }
+
+        const SnapperSnapshot snap = readSnapperMeta(info.filePath());
+        if (snap.number == 0) {
+            // Snapper writes the info.xml after creating the directory so look again on the next load
+            cache.isStale = true;
+            continue;
+        }
+
+        snapshots.insert(number, {modified, snap});
+    }
+    cache.snapshots = snapshots;
+
+    QVector<SnapperSnapshot> &configSnapshots = m_snapshots[name];
+    for (const auto &snapshot : qAsConst(cache.snapshots)) {
+        configSnapshots.append(snapshot.second);
+    }
+
+    return true;
+}
+
 SnapperResult Snapper::runSnapper(const QString &command, const QString &name) const
 {
     Result result;
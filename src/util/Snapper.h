@@ -2,7 +2,9 @@
 #define SNAPPER_H
 
 #include <QDateTime>
+#include <QHash>
 #include <QObject>
+#include <QPair>
 
 #include "Btrfs.h"
 
@@ -36,6 +38,8 @@ struct MapSubvol {
 
 /**
  * @brief The Snapper service class that handles all the interaction with the snapper application.
+ *
+ * The Btrfs object must be loaded before load() is called, nothing is loaded by the constructor.
  */
 class Snapper : public QObject {
     Q_OBJECT
@@ -79,6 +83,7 @@ class Snapper : public QObject {
     };
 
     Snapper(Btrfs *btrfs, QString snapperCommand, QObject *parent = nullptr);
+    ~Snapper();
 
     /**
      * @brief Gets the list of configuration settings for a given config
@@ -107,7 +112,11 @@ class Snapper : public QObject {
      * @param name - The name of the Snapper config
      * @param description - A string holding the description to be saved
      */
-    SnapperResult createSnapshot(const QString &name, const QString &desc) const { return runSnapper("create -d '" + desc + "'", name); }
+    SnapperResult createSnapshot(const QString &name, const QString &desc)
+    {
+        invalidateSnapshots(name);
+        return runSnapper("create -d '" + desc + "'", name);
+    }
 
     /**
      * @brief Reads the list of subvols to create mapping between the snapshot subvolume and the source subvolume
@@ -125,7 +134,11 @@ class Snapper : public QObject {
      * @param name - The name of the config that contains the snapshot to delete
      * @param num - The number of the snapshot to delete
      */
-    SnapperResult deleteSnapshot(const QString &name, const int num) const { return runSnapper("delete " + QString::number(num), name); }
+    SnapperResult deleteSnapshot(const QString &name, const int num)
+    {
+        invalidateSnapshots(name);
+        return runSnapper("delete " + QString::number(num), name);
+    }
 
     /**
      * @brief Changes the description of a given Snapper snapshot
@@ -133,8 +146,11 @@ class Snapper : public QObject {
      * @param num - The number of the snapshot to change
      * @param desc - The new description for the snapshot
      */
-    SnapperResult changeSnapshotDescription(const QString &name, const int num, const QString &desc) const
+    SnapperResult changeSnapshotDescription(const QString &name, const int num, const QString &desc)
     {
+        // The info.xml of the snapshot is rewritten in place which doesn't change the directory that is watched
+        invalidateSnapshots(name);
+
         QString asciiDesc = desc.toLatin1(); // Ensure only ASCII chars
         // Snapper does not recommend using any non ASCII chars (it's ok if you use utf-8 everywhere, but better safe than sorry)
 
@@ -160,6 +176,14 @@ class Snapper : public QObject {
      */
     QString findTargetPath(const QString &snapshotPath, const QString &filePath, const QString &uuid);
 
+    /**
+     * @brief Finds the snapshots kept in the same snapshot subvolume as @p snapshotPath
+     * @param snapshotPath - The absolute path to the root of a snapshot
+     * @param uuid - The UUID of the filesystem holding the snapshot
+     * @return The SnapperSubvolumes found by loadSubvols() which share the snapshot subvolume, including @p snapshotPath
+     */
+    QVector<SnapperSubvolume> siblingSnapshots(const QString &snapshotPath, const QString &uuid);
+
     /**
      * @brief Finds where the snapshots of @p snapshotSubvol should be restored to
      * @param snapshotSubvol - The path to the snapshot subvolume relative to the root of the filesystem
@@ -171,13 +195,17 @@ class Snapper : public QObject {
     /**
      * @brief Loads all the Snapper meta data from disk
      *
-     * Populates m_configs and m_snapshots from the results of the snapper command
+     * Populates m_configs and m_snapshots by reading the config files and the info.xml of every snapshot directly.  The
+     * results are cached and only read again after inotify reports a change, the snapper command is only used when the
+     * files can't be read.
      *
      */
     void load();
 
     /**
      * @brief loads the data for a single Snapper config
+     *
+     * The config file is read directly, falling back to snapper get-config if that fails
      * @param name - A QString that holds the name of the config to load
      */
     void loadConfig(const QString &name);
@@ -187,6 +215,12 @@ class Snapper : public QObject {
      */
     void loadSubvols();
 
+    /**
+     * @brief loads the Btrfs subvolumes that are Snapper snapshots on some of the filesystems
+     * @param uuids - The UUIDs of the filesystems to look for snapshots on
+     */
+    void loadSubvols(const QStringList &uuids);
+
     /**
      * @brief Reads the contents of a snapper metafile for a snapshot
      * @param filename - The absolute path to the meta file to read
@@ -195,10 +229,13 @@ class Snapper : public QObject {
     static SnapperSnapshot readSnapperMeta(const QString &filename);
 
     /**
-     * @brief Restores a single file identified by @p filePath to it's original location
-     * @param snapshotPath - An absolute to where the snapshot subvolume is currently mounted
-     * @param filePath - An absolute path to the file to restore
-     * @param uuid - The UUID of the filesystem the restore applies to
+     * @brief Restores a single file from a snapshot over @p destPath
+     *
+     * The data is cloned when the snapshot and the destination are on the same filesystem, so even a large file is
+     * restored instantly without using any space, and copied by the kernel otherwise.  The owner, permissions, extended
+     * attributes including ACLs and the timestamps are restored along with it.
+     * @param sourcePath - An absolute path to the file in the snapshot
+     * @param destPath - An absolute path to the file to restore over
      * @return Return true on success and false otherwise
      */
     bool restoreFile(const QString &sourcePath, const QString &destPath) const;
@@ -208,7 +245,7 @@ class Snapper : public QObject {
      * @param cleanupAlg The cleanup algorithm to use
      * @return The result of the snapper command
      */
-    SnapperResult setCleanupAlgorithm(const QString &config, const uint number, const QString &cleanupAlg) const;
+    SnapperResult setCleanupAlgorithm(const QString &config, const uint number, const QString &cleanupAlg);
 
     /**
      * @brief Updates the settings for a given Snapper config described by @p name
@@ -238,11 +275,54 @@ class Snapper : public QObject {
     QVector<SnapperSubvolume> subvols(const QString &config);
 
   private:
+    // The snapshots of a single config as they were last read from disk
+    struct SnapshotCache {
+        bool isStale = true;
+        QString path;
+        // The modification time in msecs of each info.xml and the snapshot read from it keyed by snapshot number
+        QMap<uint, QPair<qint64, SnapperSnapshot>> snapshots;
+    };
+
+    /**
+     * @brief Watches @p path with inotify and remembers which config it belongs to
+     * @param path - The absolute path of the directory to watch
+     * @param config - The name of the config, or a default constructed QString for the directory holding the configs
+     * @return True if the path is being watched
+     */
+    bool addWatch(const QString &path, const QString &config);
+
+    /**
+     * @brief Marks the cached snapshots of @p name as stale so they are read again on the next load
+     * @param name - The name of the config
+     */
+    void invalidateSnapshots(const QString &name);
+
+    /**
+     * @brief Lists the snapshots of @p name with the snapper command and adds them to m_snapshots
+     * @param name - The name of the config
+     */
+    void loadSnapperSnapshots(const QString &name);
+
     /**
      * @brief Loads the subvol map from the config file and manually mounted /.snapshots
      */
     void loadSubvolMap();
 
+    /**
+     * @brief Reads the pending inotify events and marks whatever they refer to as stale
+     */
+    void readInotifyEvents();
+
+    /**
+     * @brief Reads the snapshots of @p name from the info.xml files in its .snapshots directory and adds them to m_snapshots
+     *
+     * The directory is only listed again after the watch reports a change but the modification time of every cached
+     * info.xml is checked on each call, only the info.xml files that have changed since they were cached are parsed
+     * @param name - The name of the config
+     * @return True on success, false if the snapshot directory couldn't be found
+     */
+    bool readSnapshots(const QString &name);
+
     Btrfs *m_btrfs = nullptr;
     // The outer map is keyed with the config name, the inner map is the name, value pairs of the configuration settings
     QMap<QString, Config> m_configs;
@@ -259,6 +339,13 @@ class Snapper : public QObject {
     // Maps the subvolumes to their snapshot directories.  key is the snapshot subvol path
     QMap<QString, MapSubvol> m_subvolMap;
 
+    // The inotify descriptor used to find out when the cached metadata is stale, -1 if inotify isn't available
+    int m_inotifyFd = -1;
+    // Maps the inotify watch descriptors to the config they belong to, a null QString for the configs directory
+    QHash<int, QString> m_watches;
+    bool m_isConfigListStale = true;
+    QHash<QString, SnapshotCache> m_snapshotCache;
+
     SnapperResult runSnapper(const QString &command, const QString &name = "") const;
 };
 
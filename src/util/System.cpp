@@ -1,10 +1,22 @@
 #include "System.h"
+#include "util/CommandRunner.h"
+#include "util/Trace.h"
 
 #include <QFile>
-#include <QProcess>
 #include <QTextStream>
+#include <QtConcurrent>
 #include <unistd.h>
 
+namespace {
+
+std::unique_ptr<CommandRunner> &commandRunner()
+{
+    static std::unique_ptr<CommandRunner> runner = std::make_unique<ProcessRunner>();
+    return runner;
+}
+
+} // namespace
+
 bool System::checkRootUid() { return geteuid() == 0; }
 
 bool System::enableService(QString serviceName, bool enable)
@@ -73,17 +85,28 @@ Result System::runCmd(const QString &cmd, bool includeStderr, milliseconds timeo
 
 Result System::runCmd(const QString &cmd, const QStringList &args, bool includeStderr, milliseconds timeout)
 {
-    QProcess proc;
-
-    if (includeStderr)
-        proc.setProcessChannelMode(QProcess::MergedChannels);
+    TraceSpan span("runCmd", "process");
+    span.setArg("command", cmd);
+    span.setArg("args", args.join(' '));
+
+    const Result result = commandRunner()->run(cmd, args, includeStderr, timeout);
+    span.setArg("exitCode", result.exitCode);
+    span.setArg("timedOut", result.timedOut);
+    return result;
+}
 
-    proc.start(cmd, args);
+QFuture<Result> System::runCmdAsync(const QString &cmd, bool includeStderr, milliseconds timeout)
+{
+    return runCmdAsync("/bin/bash", QStringList() << "-c" << cmd, includeStderr, timeout);
+}
 
-    proc.waitForFinished(static_cast<int>(timeout.count()));
-    return {proc.exitCode(), proc.readAllStandardOutput().trimmed()};
+QFuture<Result> System::runCmdAsync(const QString &cmd, const QStringList &args, bool includeStderr, milliseconds timeout)
+{
+    return QtConcurrent::run([cmd, args, includeStderr, timeout]() { return runCmd(cmd, args, includeStderr, timeout); });
 }
 
+void System::setCommandRunner(std::unique_ptr<CommandRunner> runner) { commandRunner() = std::move(runner); }
+
 QString System::toHumanReadable(const uint64_t number)
 {
     auto result = static_cast<double>(number);
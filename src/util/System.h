@@ -1,13 +1,21 @@
 #ifndef SYSTEM_H
 #define SYSTEM_H
 
+#include "util/MountTable.h"
+
+#include <QFuture>
 #include <QObject>
 #include <chrono>
+#include <memory>
+
+class CommandRunner;
 
 // Stores the results from runCmd
 struct Result {
     int exitCode = -1;
     QString output;
+    // True when the command was still running after the timeout
+    bool timedOut = false;
 };
 
 /**
@@ -45,7 +53,7 @@ class System {
      *  @return Returns a QString containing the UUID or an empty string if not found
      *
      */
-    static QString findUuid(const QString path) { return runCmd("findmnt", {"-no", "uuid", path}, false).output; }
+    static QString findUuid(const QString path) { return MountTable::instance().findUuid(path); }
 
     /**
      * @brief Checks if the system is running systemd
@@ -83,6 +91,34 @@ class System {
      */
     static Result runCmd(const QString &cmd, const QStringList &args, bool includeStderr, milliseconds timeout = minutes(1));
 
+    /**
+     * @brief An overloaded version of runCmdAsync which takes a string and runs it with bash -c
+     * @param cmd - The command to pass to bash -c
+     * @param includeStderr - When true stderr is included in the Result.output
+     * @param timeout - How long (in milliseconds resolution) the command should run before timing out
+     * @return A QFuture that holds the Result once the command finishes
+     */
+    static QFuture<Result> runCmdAsync(const QString &cmd, bool includeStderr, milliseconds timeout = minutes(1));
+
+    /**
+     * @brief Runs a command on the host system from a worker thread so the calling thread never waits on it
+     * @param cmd - The absolute path to the binary/script to run
+     * @param args - A list of arguments for @p cmd
+     * @param includeStderr - When true stderr is included in the Result.output
+     * @param timeout - How long (in milliseconds resolution) the command should run before timing out
+     * @return A QFuture that holds the Result once the command finishes
+     */
+    static QFuture<Result> runCmdAsync(const QString &cmd, const QStringList &args, bool includeStderr,
+                                       milliseconds timeout = minutes(1));
+
+    /**
+     * @brief Replaces the runner used by runCmd, by default commands are run with a ProcessRunner
+     *
+     * Must be called before any command is run.
+     * @param runner - The new runner, System takes ownership of it
+     */
+    static void setCommandRunner(std::unique_ptr<CommandRunner> runner);
+
     /** @brief Starts the systemd unit with the unit name of @p unit
      *
      *  Returns a Result struct from runCmd()
@@ -0,0 +1,82 @@
+#include "util/Trace.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+Trace &Trace::instance()
+{
+    static Trace instance;
+    return instance;
+}
+
+Trace::~Trace()
+{
+    if (!m_isEnabled) {
+        return;
+    }
+
+    QMutexLocker lock(&m_mutex);
+    QFile file(m_filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Failed to write the trace to" << m_filePath << ":" << file.errorString();
+        return;
+    }
+
+    QJsonObject trace;
+    trace.insert("traceEvents", m_events);
+    trace.insert("displayTimeUnit", "ms");
+    file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact));
+}
+
+void Trace::addSpan(const char *name, const char *category, qint64 start, qint64 duration, const QVariantMap &args)
+{
+    QJsonObject event;
+    event.insert("name", name);
+    event.insert("cat", category);
+    event.insert("ph", "X");
+    event.insert("ts", start);
+    event.insert("dur", duration);
+    event.insert("pid", static_cast<qint64>(getpid()));
+    event.insert("tid", static_cast<qint64>(syscall(SYS_gettid)));
+    if (!args.isEmpty()) {
+        event.insert("args", QJsonObject::fromVariantMap(args));
+    }
+
+    QMutexLocker lock(&m_mutex);
+    m_events.append(event);
+}
+
+void Trace::start(const QString &filePath)
+{
+    QMutexLocker lock(&m_mutex);
+    m_filePath = filePath;
+    m_timer.start();
+    m_isEnabled = true;
+}
+
+TraceSpan::TraceSpan(const char *name, const char *category)
+    : m_name(name), m_category(category), m_isEnabled(Trace::instance().isEnabled())
+{
+    if (m_isEnabled) {
+        m_start = Trace::instance().now();
+    }
+}
+
+TraceSpan::~TraceSpan()
+{
+    if (m_isEnabled) {
+        Trace &trace = Trace::instance();
+        trace.addSpan(m_name, m_category, m_start, trace.now() - m_start, m_args);
+    }
+}
+
+void TraceSpan::setArg(const QString &key, const QVariant &value)
+{
+    if (m_isEnabled) {
+        m_args.insert(key, value);
+    }
+}
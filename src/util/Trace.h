@@ -0,0 +1,99 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QMutex>
+#include <QString>
+#include <QVariantMap>
+
+#include <atomic>
+
+/**
+ * @brief The Trace class is a singleton that records timed spans and writes them as Chrome trace event JSON
+ *
+ * Tracing is off unless start() is called, which main() does for --trace or the BTRFS_ASSISTANT_TRACE environment
+ * variable.  The file is written when the application exits and can be opened in chrome://tracing or Perfetto.
+ */
+class Trace {
+  public:
+    /**
+     * @brief Gets a reference to the Trace object
+     */
+    static Trace &instance();
+
+    /**
+     * @brief Records a complete span
+     * @param name - The name shown for the span
+     * @param category - The category used to group and filter spans
+     * @param start - When the span started in usecs since tracing started
+     * @param duration - How long the span lasted in usecs
+     * @param args - Extra details shown when the span is selected
+     */
+    void addSpan(const char *name, const char *category, qint64 start, qint64 duration, const QVariantMap &args);
+
+    /**
+     * @brief Returns true if spans are being recorded
+     */
+    bool isEnabled() const { return m_isEnabled; }
+
+    /**
+     * @brief Returns the time in usecs since tracing started
+     */
+    qint64 now() const { return m_timer.nsecsElapsed() / 1000; }
+
+    /**
+     * @brief Starts recording spans
+     * @param filePath - The path of the file the trace is written to on exit
+     */
+    void start(const QString &filePath);
+
+  private:
+    Trace() = default;
+    ~Trace();
+    // Delete the copy constructor and the assignment operator
+    Trace(Trace const &) = delete;
+    void operator=(Trace const &) = delete;
+
+    std::atomic<bool> m_isEnabled{false};
+    QString m_filePath;
+    QElapsedTimer m_timer;
+    QMutex m_mutex;
+    QJsonArray m_events;
+};
+
+/**
+ * @brief The TraceSpan class records a span from its construction until it is destroyed
+ *
+ * Does nothing beyond checking Trace::isEnabled() when tracing is off.
+ */
+class TraceSpan {
+  public:
+    /**
+     * @brief Starts a span
+     * @param name - The name shown for the span, must be a string literal
+     * @param category - The category of the span, must be a string literal
+     */
+    TraceSpan(const char *name, const char *category);
+    ~TraceSpan();
+
+    /**
+     * @brief Adds a detail to the span which is shown when the span is selected
+     * @param key - The name of the detail
+     * @param value - The value of the detail
+     */
+    void setArg(const QString &key, const QVariant &value);
+
+  private:
+    // Delete the copy constructor and the assignment operator
+    TraceSpan(TraceSpan const &) = delete;
+    void operator=(TraceSpan const &) = delete;
+
+    const char *m_name;
+    const char *m_category;
+    bool m_isEnabled;
+    qint64 m_start = 0;
+    QVariantMap m_args;
+};
+
+#endif // TRACE_H
@@ -0,0 +1,132 @@
+#include "widgets/DiffView.h"
+#include "model/DiffModel.h"
+
+#include <QClipboard>
+#include <QGuiApplication>
+#include <QKeyEvent>
+#include <QPainter>
+#include <QStyledItemDelegate>
+
+#include <algorithm>
+
+namespace {
+
+// The space left of each line
+constexpr int LINE_MARGIN = 4;
+
+/**
+ * @brief The DiffLineDelegate class paints a line of a diff in the colour for its kind of line
+ */
+class DiffLineDelegate : public QStyledItemDelegate {
+  public:
+    using QStyledItemDelegate::QStyledItemDelegate;
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const override
+    {
+        painter->save();
+
+        QColor textColor = option.palette.color(QPalette::Text);
+        if (option.state & QStyle::State_Selected) {
+            painter->fillRect(option.rect, option.palette.highlight());
+            textColor = option.palette.color(QPalette::HighlightedText);
+        } else {
+            switch (index.data(DiffModel::Role::Kind).toInt()) {
+            case DiffModel::LineKind::Added:
+                textColor = Qt::darkGreen;
+                break;
+            case DiffModel::LineKind::Removed:
+                textColor = Qt::red;
+                break;
+            case DiffModel::LineKind::Hunk:
+                textColor = Qt::darkCyan;
+                break;
+            }
+        }
+
+        painter->setFont(option.font);
+        painter->setPen(textColor);
+        painter->drawText(option.rect.adjusted(LINE_MARGIN, 0, 0, 0),
+                          Qt::AlignLeft | Qt::AlignVCenter | Qt::TextSingleLine | Qt::TextExpandTabs, index.data().toString());
+
+        painter->restore();
+    }
+
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const override
+    {
+        // The view only asks for the size of the first row and uses it for all of them so it has to fit the longest line
+        const auto *model = static_cast<const DiffModel *>(index.model());
+        const QFontMetrics metrics(option.font);
+        return QSize(model->maxLineLength() * metrics.horizontalAdvance(QLatin1Char('M')) + 2 * LINE_MARGIN, metrics.height());
+    }
+};
+
+} // namespace
+
+DiffView::DiffView(QWidget *parent) : QListView(parent), m_model(new DiffModel(this))
+{
+    setModel(m_model);
+    setItemDelegate(new DiffLineDelegate(this));
+    setUniformItemSizes(true);
+    setEditTriggers(QAbstractItemView::NoEditTriggers);
+    setSelectionMode(QAbstractItemView::ExtendedSelection);
+    setHorizontalScrollMode(QAbstractItemView::ScrollPerPixel);
+}
+
+void DiffView::setDiff(const QStringList &lines)
+{
+    m_model->load(lines);
+    scrollToTop();
+}
+
+void DiffView::setMessage(const QString &message)
+{
+    m_model->setMessage(message);
+    scrollToTop();
+}
+
+void DiffView::nextHunk()
+{
+    // Move on from the hunk last jumped to, or from the top of the view before any jumps
+    const QVector<int> &hunkRows = m_model->hunkRows();
+    const int row = currentIndex().isValid() ? currentIndex().row() : indexAt(QPoint(0, 0)).row();
+    const auto next = std::upper_bound(hunkRows.cbegin(), hunkRows.cend(), row);
+    if (next != hunkRows.cend()) {
+        showRow(*next);
+    }
+}
+
+void DiffView::previousHunk()
+{
+    const QVector<int> &hunkRows = m_model->hunkRows();
+    const int row = currentIndex().isValid() ? currentIndex().row() : indexAt(QPoint(0, 0)).row();
+    const auto next = std::lower_bound(hunkRows.cbegin(), hunkRows.cend(), row);
+    if (next != hunkRows.cbegin()) {
+        showRow(*(next - 1));
+    }
+}
+
+void DiffView::keyPressEvent(QKeyEvent *event)
+{
+    if (!event->matches(QKeySequence::Copy)) {
+        QListView::keyPressEvent(event);
+        return;
+    }
+
+    // Copy the selected lines in the order they appear in the diff rather than the order they were selected in
+    QModelIndexList indexes = selectionModel()->selectedRows();
+    std::sort(indexes.begin(), indexes.end());
+
+    QStringList lines;
+    lines.reserve(indexes.count());
+    for (const QModelIndex &index : qAsConst(indexes)) {
+        lines.append(index.data().toString());
+    }
+    QGuiApplication::clipboard()->setText(lines.join('\n'));
+}
+
+void DiffView::showRow(int row)
+{
+    const QModelIndex index = m_model->index(row);
+    setCurrentIndex(index);
+    scrollTo(index, QAbstractItemView::PositionAtTop);
+}
@@ -0,0 +1,55 @@
+#ifndef DIFFVIEW_H
+#define DIFFVIEW_H
+
+#include <QListView>
+
+class DiffModel;
+
+/**
+ * @brief The DiffView class shows a unified diff one line per row
+ *
+ * Every row has the same size so only the rows on screen are laid out and painted, which keeps showing a diff just as
+ * fast no matter how long it is.  The lines are coloured by a delegate as they are painted.
+ */
+class DiffView : public QListView {
+    Q_OBJECT
+
+  public:
+    explicit DiffView(QWidget *parent = nullptr);
+
+    /**
+     * @brief Shows a diff
+     * @param lines - The lines of a diff in unified format
+     */
+    void setDiff(const QStringList &lines);
+
+    /**
+     * @brief Shows a message in place of a diff
+     * @param message - The text to show
+     */
+    void setMessage(const QString &message);
+
+  public slots:
+    /**
+     * @brief Scrolls the next hunk below the top of the view to the top
+     */
+    void nextHunk();
+
+    /**
+     * @brief Scrolls the hunk before the top of the view to the top
+     */
+    void previousHunk();
+
+  protected:
+    void keyPressEvent(QKeyEvent *event) override;
+
+  private:
+    DiffModel *m_model;
+
+    /**
+     * @brief Makes @p row the current row and scrolls it to the top of the view
+     */
+    void showRow(int row);
+};
+
+#endif // DIFFVIEW_H